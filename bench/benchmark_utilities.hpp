@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace cilantro_bench {
+    struct BenchmarkResult {
+        std::string benchmark;
+        std::string parameters;
+        size_t num_points;
+        int num_threads;
+        size_t repeats;
+        double median_ms;
+        double min_ms;
+        std::vector<std::pair<std::string,double> > metrics;
+    };
+
+    struct BenchmarkOptions {
+        BenchmarkOptions() : sizes({10000, 100000}), threads({1}), repeats(3), format("csv"), filter("") {}
+
+        std::vector<size_t> sizes;
+        std::vector<int> threads;
+        size_t repeats;
+        std::string format;
+        std::string filter;
+
+        inline bool enabled(const std::string &benchmark) const { return filter.empty() || benchmark.find(filter) != std::string::npos; }
+    };
+
+    inline void setNumberOfThreads(int num_threads) {
+#ifdef _OPENMP
+        omp_set_num_threads(num_threads);
+#endif
+    }
+
+    inline int getMaxNumberOfThreads() {
+#ifdef _OPENMP
+        return omp_get_max_threads();
+#else
+        return 1;
+#endif
+    }
+
+    // Runs setup() (untimed) and then fun() (timed) for the given number of repeats; returns {median, min} in ms
+    template <class SetupFunT, class FunT>
+    std::pair<double,double> timeFunction(size_t repeats, SetupFunT setup, FunT fun) {
+        std::vector<double> times(std::max(repeats, (size_t)1));
+        for (size_t i = 0; i < times.size(); i++) {
+            setup();
+            auto start = std::chrono::high_resolution_clock::now();
+            fun();
+            auto end = std::chrono::high_resolution_clock::now();
+            times[i] = std::chrono::duration<double, std::milli>(end - start).count();
+        }
+        std::sort(times.begin(), times.end());
+        return std::pair<double,double>(times[times.size()/2], times[0]);
+    }
+
+    template <class FunT>
+    std::pair<double,double> timeFunction(size_t repeats, FunT fun) {
+        return timeFunction(repeats, [](){}, fun);
+    }
+
+    // Keeps results alive so that the optimizer cannot discard benchmarked computations: the value's address
+    // escapes into an opaque barrier that may read all memory
+    template <class T>
+    inline void doNotOptimizeAway(const T &value) {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "g"(&value) : "memory");
+#else
+        static const void * volatile sink;
+        sink = &value;
+#endif
+    }
+
+    class BenchmarkWriter {
+    public:
+        BenchmarkWriter(std::ostream &out, const std::string &format) : out_(out), json_(format == "json"), count_(0) {
+            if (json_) {
+                out_ << "[" << std::endl;
+            } else {
+                out_ << "benchmark,parameters,num_points,num_threads,repeats,median_ms,min_ms,metrics" << std::endl;
+            }
+        }
+
+        ~BenchmarkWriter() {
+            if (json_) out_ << std::endl << "]" << std::endl;
+        }
+
+        void write(const BenchmarkResult &res) {
+            if (json_) {
+                if (count_ > 0) out_ << "," << std::endl;
+                out_ << "  {\"benchmark\": \"" << res.benchmark << "\", \"parameters\": \"" << res.parameters
+                     << "\", \"num_points\": " << res.num_points << ", \"num_threads\": " << res.num_threads
+                     << ", \"repeats\": " << res.repeats << ", \"median_ms\": " << res.median_ms << ", \"min_ms\": " << res.min_ms;
+                for (size_t i = 0; i < res.metrics.size(); i++) {
+                    out_ << ", \"" << res.metrics[i].first << "\": " << res.metrics[i].second;
+                }
+                out_ << "}";
+            } else {
+                out_ << res.benchmark << "," << res.parameters << "," << res.num_points << "," << res.num_threads << ","
+                     << res.repeats << "," << res.median_ms << "," << res.min_ms << ",";
+                for (size_t i = 0; i < res.metrics.size(); i++) {
+                    if (i > 0) out_ << ";";
+                    out_ << res.metrics[i].first << "=" << res.metrics[i].second;
+                }
+                out_ << std::endl;
+            }
+            out_.flush();
+            count_++;
+        }
+
+        void write(const std::string &benchmark, const std::string &parameters, size_t num_points, int num_threads, size_t repeats,
+                   const std::pair<double,double> &times, const std::vector<std::pair<std::string,double> > &metrics = std::vector<std::pair<std::string,double> >())
+        {
+            BenchmarkResult res;
+            res.benchmark = benchmark;
+            res.parameters = parameters;
+            res.num_points = num_points;
+            res.num_threads = num_threads;
+            res.repeats = repeats;
+            res.median_ms = times.first;
+            res.min_ms = times.second;
+            res.metrics = metrics;
+            write(res);
+        }
+
+    private:
+        std::ostream &out_;
+        bool json_;
+        size_t count_;
+    };
+
+    template <typename T>
+    std::vector<T> parseList(const std::string &str) {
+        std::vector<T> res;
+        std::stringstream ss(str);
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            if (item.empty()) continue;
+            std::stringstream item_ss(item);
+            T val;
+            item_ss >> val;
+            res.emplace_back(val);
+        }
+        return res;
+    }
+
+    template <typename T>
+    std::string toString(const T &val) {
+        std::stringstream ss;
+        ss << val;
+        return ss.str();
+    }
+}
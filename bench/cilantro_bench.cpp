@@ -0,0 +1,930 @@
+#include <cstdio>
+#include <fstream>
+#include <atomic>
+#include <thread>
+#include <cilantro/kd_tree.hpp>
+#include <cilantro/dynamic_kd_tree.hpp>
+#include <cilantro/kd_forest.hpp>
+#include <cilantro/concurrent_kd_tree.hpp>
+#include <cilantro/hash_grid.hpp>
+#include <cilantro/octree.hpp>
+#include <cilantro/morton_order.hpp>
+#include <cilantro/voxel_grid.hpp>
+#include <cilantro/voxel_map.hpp>
+#include <cilantro/normal_estimation.hpp>
+#include <cilantro/kmeans.hpp>
+#include <cilantro/iterative_closest_point.hpp>
+#include <cilantro/normal_distributions_transform.hpp>
+#include <cilantro/plane_estimator.hpp>
+#include <cilantro/connected_component_segmentation.hpp>
+#include <cilantro/neighborhood_graph.hpp>
+#include "benchmark_utilities.hpp"
+#include "synthetic_clouds.hpp"
+
+using namespace cilantro_bench;
+
+void benchKDTree(const BenchmarkOptions &opt, BenchmarkWriter &writer, size_t n, int t) {
+    std::vector<Eigen::Vector3f> points = generateUniformPoints<float,3>(n, 1);
+    std::vector<Eigen::Vector3f> queries = generateUniformPoints<float,3>(n, 2);
+
+    if (opt.enabled("kd_tree_build")) {
+        writer.write("kd_tree_build", "leaf_size=10", n, t, opt.repeats, timeFunction(opt.repeats, [&]() {
+            cilantro::KDTree3D tree(points);
+            doNotOptimizeAway(tree);
+        }));
+    }
+
+    cilantro::KDTree3D tree(points);
+
+    if (opt.enabled("kd_tree_load")) {
+        // Loading a saved index, to compare against kd_tree_build
+        const std::string index_file("cilantro_bench_kd_tree.idx");
+        tree.saveIndex(index_file);
+        writer.write("kd_tree_load", "leaf_size=10", n, t, opt.repeats, timeFunction(opt.repeats, [&]() {
+            cilantro::KDTree3D loaded(points, index_file);
+            doNotOptimizeAway(loaded);
+        }));
+        std::remove(index_file.c_str());
+    }
+
+    if (opt.enabled("kd_tree_knn")) {
+        size_t ks[] = {1, 10};
+        for (size_t k : ks) {
+            writer.write("kd_tree_knn", "k=" + toString(k), n, t, opt.repeats, timeFunction(opt.repeats, [&]() {
+                std::vector<size_t> neighbors;
+                std::vector<float> distances;
+#pragma omp parallel for private (neighbors, distances)
+                for (size_t i = 0; i < queries.size(); i++) {
+                    tree.kNNSearch(queries[i], k, neighbors, distances);
+                }
+            }));
+        }
+    }
+
+    if (opt.enabled("kd_tree_flat_knn")) {
+        // Same searches as kd_tree_knn, on the flat node layout
+        cilantro::KDTree3D flat_tree(points, 10, true);
+        size_t ks[] = {1, 10};
+        for (size_t k : ks) {
+            writer.write("kd_tree_flat_knn", "k=" + toString(k), n, t, opt.repeats, timeFunction(opt.repeats, [&]() {
+                std::vector<size_t> neighbors;
+                std::vector<float> distances;
+#pragma omp parallel for private (neighbors, distances)
+                for (size_t i = 0; i < queries.size(); i++) {
+                    flat_tree.kNNSearch(queries[i], k, neighbors, distances);
+                }
+            }));
+        }
+    }
+
+    if (opt.enabled("kd_tree_batch_knn")) {
+        cilantro::NeighborhoodSet<float> results;
+        writer.write("kd_tree_batch_knn", "k=10", n, t, opt.repeats, timeFunction(opt.repeats, [&]() {
+            tree.kNNSearch(queries, 10, results);
+        }));
+    }
+
+    if (opt.enabled("kd_tree_dual_tree_knn")) {
+        // The query tree is built once (as when ICP reuses it across iterations) and only traversed here
+        cilantro::KDTree3D query_tree(queries);
+        cilantro::NeighborhoodSet<float> results;
+        size_t ks[] = {1, 10};
+        for (size_t k : ks) {
+            writer.write("kd_tree_dual_tree_knn", "k=" + toString(k), n, t, opt.repeats, timeFunction(opt.repeats, [&]() {
+                tree.dualTreeKNNSearch(query_tree, k, results);
+            }));
+        }
+    }
+
+    if (opt.enabled("kd_tree_approx_knn")) {
+        // Speed/recall trade-off of approximate search; recall is the fraction of the exact k nearest
+        // neighbors that are returned
+        size_t ks[] = {1, 10};
+        float epss[] = {0.0f, 0.5f, 1.0f, 2.0f};
+        for (size_t k : ks) {
+            cilantro::NeighborhoodSet<float> exact, approx;
+            tree.kNNSearch(queries, k, exact);
+            for (float eps : epss) {
+                std::pair<double,double> times = timeFunction(opt.repeats, [&]() {
+                    tree.kNNSearch(queries, k, approx, eps);
+                });
+                size_t num_found = 0;
+                for (size_t i = 0; i < exact.size(); i++) {
+                    std::vector<size_t> truth(exact.getNeighborIndices(i), exact.getNeighborIndices(i) + exact.getNeighborhoodSize(i));
+                    std::sort(truth.begin(), truth.end());
+                    for (size_t j = 0; j < approx.getNeighborhoodSize(i); j++) {
+                        if (std::binary_search(truth.begin(), truth.end(), approx.getNeighborIndices(i)[j])) num_found++;
+                    }
+                }
+                double recall = (exact.indices.empty()) ? 1.0 : (double)num_found/exact.indices.size();
+                writer.write("kd_tree_approx_knn", "k=" + toString(k) + " eps=" + toString(eps), n, t, opt.repeats, times, {{"recall", recall}});
+            }
+        }
+    }
+
+    // Radius for ~20 neighbors in the unit cube
+    float radius = std::cbrt(20.0f*3.0f/(4.0f*(float)M_PI*n));
+    float radius_sq = radius*radius;
+
+    if (opt.enabled("kd_tree_radius")) {
+        writer.write("kd_tree_radius", "r=" + toString(radius), n, t, opt.repeats, timeFunction(opt.repeats, [&]() {
+            std::vector<size_t> neighbors;
+            std::vector<float> distances;
+#pragma omp parallel for private (neighbors, distances)
+            for (size_t i = 0; i < queries.size(); i++) {
+                tree.radiusSearch(queries[i], radius_sq, neighbors, distances);
+            }
+        }));
+    }
+
+    if (opt.enabled("kd_tree_context_radius")) {
+        writer.write("kd_tree_context_radius", "r=" + toString(radius), n, t, opt.repeats, timeFunction(opt.repeats, [&]() {
+            cilantro::SearchContext<float> context;
+#pragma omp parallel for private (context)
+            for (size_t i = 0; i < queries.size(); i++) {
+                tree.radiusSearch(queries[i], radius_sq, context);
+            }
+        }));
+    }
+
+    if (opt.enabled("kd_tree_batch_radius")) {
+        cilantro::NeighborhoodSet<float> results;
+        writer.write("kd_tree_batch_radius", "r=" + toString(radius), n, t, opt.repeats, timeFunction(opt.repeats, [&]() {
+            tree.radiusSearch(queries, radius_sq, results);
+        }));
+    }
+
+    if (opt.enabled("kd_tree_knn_in_radius")) {
+        // Dense (~20 points in radius) and sparse (~2 points in radius) neighborhoods, k = 10
+        float radii_sq[] = {radius_sq, radius_sq*std::cbrt(0.01f)};
+        for (float r_sq : radii_sq) {
+            writer.write("kd_tree_knn_in_radius", "k=10 r=" + toString(std::sqrt(r_sq)), n, t, opt.repeats, timeFunction(opt.repeats, [&]() {
+                cilantro::SearchContext<float> context;
+#pragma omp parallel for private (context)
+                for (size_t i = 0; i < queries.size(); i++) {
+                    tree.kNNInRadiusSearch(queries[i], 10, r_sq, context);
+                }
+            }));
+        }
+    }
+
+    if (opt.enabled("kd_tree_radius_count")) {
+        std::vector<size_t> counts;
+        writer.write("kd_tree_radius_count", "r=" + toString(radius), n, t, opt.repeats, timeFunction(opt.repeats, [&]() {
+            tree.radiusCount(queries, radius_sq, counts);
+        }));
+    }
+
+    if (opt.enabled("kd_tree_box")) {
+        // 100 crop boxes of 1% of the cube volume each, against a radius search over the box's circumscribed
+        // ball followed by filtering
+        float side = std::cbrt(0.01f);
+        size_t num_boxes = std::min<size_t>(100, queries.size());
+        size_t total = 0;
+        std::pair<double,double> times = timeFunction(opt.repeats, [&]() {
+            total = 0;
+            std::vector<size_t> neighbors, cropped;
+            std::vector<float> distances;
+            for (size_t b = 0; b < num_boxes; b++) {
+                Eigen::Vector3f min_pt = queries[b]*(1.0f - side);
+                Eigen::Vector3f max_pt = min_pt + Eigen::Vector3f::Constant(side);
+                tree.radiusSearch((0.5f*(min_pt + max_pt)).eval(), 0.75f*side*side, neighbors, distances);
+                cropped.clear();
+                for (size_t i = 0; i < neighbors.size(); i++) {
+                    if ((points[neighbors[i]].array() >= min_pt.array()).all() && (points[neighbors[i]].array() <= max_pt.array()).all()) cropped.emplace_back(neighbors[i]);
+                }
+                total += cropped.size();
+            }
+        });
+        writer.write("kd_tree_box", "method=radius_filter", n, t, opt.repeats, times, {{"points", (double)total}});
+
+        times = timeFunction(opt.repeats, [&]() {
+            total = 0;
+            std::vector<size_t> cropped;
+            for (size_t b = 0; b < num_boxes; b++) {
+                Eigen::Vector3f min_pt = queries[b]*(1.0f - side);
+                tree.boxSearch(min_pt, (min_pt + Eigen::Vector3f::Constant(side)).eval(), cropped);
+                total += cropped.size();
+            }
+        });
+        writer.write("kd_tree_box", "method=box_search", n, t, opt.repeats, times, {{"points", (double)total}});
+
+        times = timeFunction(opt.repeats, [&]() {
+            total = 0;
+            for (size_t b = 0; b < num_boxes; b++) {
+                Eigen::Vector3f min_pt = queries[b]*(1.0f - side);
+                total += tree.boxCount(min_pt, (min_pt + Eigen::Vector3f::Constant(side)).eval());
+            }
+        });
+        writer.write("kd_tree_box", "method=box_count", n, t, opt.repeats, times, {{"points", (double)total}});
+    }
+}
+
+// Batched kNN with the plain and the block-scanning (vectorized) L2 adaptor, in the dimensions used by ICP
+template <ptrdiff_t EigenDim>
+void benchKDTreeL2Vectorized(const BenchmarkOptions &opt, BenchmarkWriter &writer, size_t n, int t) {
+    if (!opt.enabled("kd_tree_l2")) return;
+    std::vector<Eigen::Matrix<float,EigenDim,1> > points = generateUniformPoints<float,EigenDim>(n, 1);
+    std::vector<Eigen::Matrix<float,EigenDim,1> > queries = generateUniformPoints<float,EigenDim>(n, 2);
+    cilantro::KDTree<float,EigenDim,cilantro::KDTreeDistanceAdaptors::L2> tree(points);
+    cilantro::KDTree<float,EigenDim,cilantro::KDTreeDistanceAdaptors::L2Vectorized> tree_vec(points);
+
+    size_t ks[] = {1, 10};
+    for (size_t k : ks) {
+        cilantro::NeighborhoodSet<float> results;
+        std::string params("dim=" + toString(EigenDim) + " k=" + toString(k));
+        writer.write("kd_tree_l2_knn", params, n, t, opt.repeats, timeFunction(opt.repeats, [&]() {
+            tree.kNNSearch(queries, k, results);
+        }));
+        writer.write("kd_tree_l2_vectorized_knn", params, n, t, opt.repeats, timeFunction(opt.repeats, [&]() {
+            tree_vec.kNNSearch(queries, k, results);
+        }));
+    }
+}
+
+// 33-D descriptor-like data (12 intrinsic dimensions, linearly embedded): exact kd-tree search against the
+// randomized kd-forest at increasing check budgets, with recall@k against the exact results
+void benchKDForest(const BenchmarkOptions &opt, BenchmarkWriter &writer, size_t n, int t) {
+    if (!opt.enabled("kd_forest")) return;
+
+    const ptrdiff_t dim = 33;
+    const size_t k = 10;
+    size_t num_queries = std::min<size_t>(n, 1000);
+    std::vector<Eigen::Matrix<float,12,1> > latent = generateUniformPoints<float,12>(n + num_queries, 1);
+    std::vector<Eigen::Matrix<float,dim,1> > embedding = generateUniformPoints<float,dim>(12, 2);
+    Eigen::Matrix<float,dim,Eigen::Dynamic> points(dim, n), queries(dim, num_queries);
+    for (size_t i = 0; i < n + num_queries; i++) {
+        Eigen::Matrix<float,dim,1> p(Eigen::Matrix<float,dim,1>::Zero());
+        for (size_t j = 0; j < 12; j++) p += (latent[i][j] - 0.5f)*embedding[j];
+        if (i < n) points.col(i) = p;
+        else queries.col(i - n) = p;
+    }
+
+    cilantro::KDTree<float,dim,cilantro::KDTreeDistanceAdaptors::L2> tree(points);
+    cilantro::NeighborhoodSet<float> exact, results;
+    writer.write("kd_forest_knn", "dim=33 k=10 exact", n, t, opt.repeats, timeFunction(opt.repeats, [&]() {
+        tree.kNNSearch(queries, k, exact);
+    }));
+
+    size_t num_trees = 4;
+    cilantro::KDForest<float,dim,cilantro::KDTreeDistanceAdaptors::L2> forest(points, num_trees);
+    size_t checks[] = {128, 512, 2048};
+    for (size_t c : checks) {
+        forest.setMaxChecks(c);
+        std::pair<double,double> times = timeFunction(opt.repeats, [&]() {
+            forest.kNNSearch(queries, k, results);
+        });
+        size_t hits = 0;
+        for (size_t q = 0; q < num_queries; q++) {
+            for (size_t j = 0; j < results.getNeighborhoodSize(q); j++) {
+                const size_t * exact_begin = exact.getNeighborIndices(q);
+                const size_t * exact_end = exact_begin + exact.getNeighborhoodSize(q);
+                if (std::find(exact_begin, exact_end, results.getNeighborIndices(q)[j]) != exact_end) hits++;
+            }
+        }
+        writer.write("kd_forest_knn", "dim=33 k=10 trees=" + toString(num_trees) + " checks=" + toString(c), n, t, opt.repeats, times, {{"recall", (double)hits/std::max<size_t>(exact.indices.size(), 1)}});
+    }
+}
+
+void benchDynamicKDTree(const BenchmarkOptions &opt, BenchmarkWriter &writer, size_t n, int t) {
+    std::vector<Eigen::Vector3f> points = generateUniformPoints<float,3>(n, 1);
+    std::vector<Eigen::Vector3f> queries = generateUniformPoints<float,3>(n, 2);
+    size_t batch_size = std::max(n/100, (size_t)1);
+
+    if (opt.enabled("dynamic_kd_tree_insert")) {
+        // Incremental insertion in batches, against rebuilding a static tree after every batch
+        writer.write("dynamic_kd_tree_insert", "batch=" + toString(batch_size), n, t, opt.repeats, timeFunction(opt.repeats, [&]() {
+            cilantro::DynamicKDTree3D tree;
+            for (size_t i = 0; i < n; i += batch_size) {
+                tree.addPoints(cilantro::ConstDataMatrixMap<float,3>(points[i].data(), std::min(batch_size, n - i)));
+            }
+            doNotOptimizeAway(tree);
+        }));
+        writer.write("kd_tree_rebuild_insert", "batch=" + toString(batch_size), n, t, opt.repeats, timeFunction(opt.repeats, [&]() {
+            for (size_t i = 0; i < n; i += batch_size) {
+                cilantro::KDTree3D tree(cilantro::ConstDataMatrixMap<float,3>(points[0].data(), std::min(i + batch_size, n)));
+                doNotOptimizeAway(tree);
+            }
+        }));
+    }
+
+    if (opt.enabled("dynamic_kd_tree_knn")) {
+        // Forest built incrementally, with a quarter of the points removed
+        cilantro::DynamicKDTree3D tree;
+        for (size_t i = 0; i < n; i += batch_size) {
+            tree.addPoints(cilantro::ConstDataMatrixMap<float,3>(points[i].data(), std::min(batch_size, n - i)));
+        }
+        std::vector<size_t> removed;
+        for (size_t i = 0; i < n; i += 4) removed.emplace_back(i);
+        tree.removePoints(removed);
+
+        cilantro::NeighborhoodSet<float> results;
+        writer.write("dynamic_kd_tree_knn", "k=10 trees=" + toString(tree.getNumberOfTrees()), n, t, opt.repeats, timeFunction(opt.repeats, [&]() {
+            tree.kNNSearch(queries, 10, results);
+        }));
+    }
+}
+
+void benchConcurrentKDTree(const BenchmarkOptions &opt, BenchmarkWriter &writer, size_t n, int t) {
+    if (!opt.enabled("concurrent_kd_tree")) return;
+
+    std::vector<Eigen::Vector3f> points = generateUniformPoints<float,3>(n, 1);
+    std::vector<Eigen::Vector3f> queries = generateUniformPoints<float,3>(n, 2);
+    size_t neighbor = 0;
+    float distance = 0.0f;
+
+    // Single-query latency through the shared handle (one snapshot acquisition per query) against the plain tree
+    cilantro::KDTree3D tree(points);
+    writer.write("concurrent_kd_tree_nn", "handle=0", n, t, opt.repeats, timeFunction(opt.repeats, [&]() {
+        for (size_t i = 0; i < queries.size(); i++) {
+            tree.nearestNeighborSearch(queries[i], neighbor, distance);
+        }
+        doNotOptimizeAway(neighbor);
+    }));
+
+    cilantro::ConcurrentKDTree3D handle(points);
+    writer.write("concurrent_kd_tree_nn", "handle=1", n, t, opt.repeats, timeFunction(opt.repeats, [&]() {
+        for (size_t i = 0; i < queries.size(); i++) {
+            handle.nearestNeighborSearch(queries[i], neighbor, distance);
+        }
+        doNotOptimizeAway(neighbor);
+    }));
+
+    // Same queries while another thread keeps rebuilding and publishing the map
+    std::atomic<bool> done(false);
+    std::thread updater([&]() {
+        while (!done.load()) handle.update(points);
+    });
+    size_t version = handle.getVersion();
+    std::pair<double,double> times = timeFunction(opt.repeats, [&]() {
+        for (size_t i = 0; i < queries.size(); i++) {
+            handle.nearestNeighborSearch(queries[i], neighbor, distance);
+        }
+        doNotOptimizeAway(neighbor);
+    });
+    done.store(true);
+    updater.join();
+    writer.write("concurrent_kd_tree_nn_during_update", "handle=1", n, t, opt.repeats, times, {{"updates", (double)(handle.getVersion() - version)}});
+
+    writer.write("concurrent_kd_tree_update", "leaf=10", n, t, opt.repeats, timeFunction(opt.repeats, [&]() {
+        handle.update(points);
+    }));
+}
+
+void benchHashGrid(const BenchmarkOptions &opt, BenchmarkWriter &writer, size_t n, int t) {
+    std::vector<Eigen::Vector3f> points = generateUniformPoints<float,3>(n, 1);
+    std::vector<Eigen::Vector3f> queries = generateUniformPoints<float,3>(n, 2);
+
+    // Same radius as kd_tree_radius, used as the cell size
+    float radius = std::cbrt(20.0f*3.0f/(4.0f*(float)M_PI*n));
+    float radius_sq = radius*radius;
+
+    if (opt.enabled("hash_grid_build")) {
+        writer.write("hash_grid_build", "cell=" + toString(radius), n, t, opt.repeats, timeFunction(opt.repeats, [&]() {
+            cilantro::HashGrid3D grid(points, radius);
+            doNotOptimizeAway(grid);
+        }));
+    }
+
+    cilantro::HashGrid3D grid(points, radius);
+
+    if (opt.enabled("hash_grid_radius")) {
+        writer.write("hash_grid_radius", "r=" + toString(radius), n, t, opt.repeats, timeFunction(opt.repeats, [&]() {
+            cilantro::SearchContext<float> context;
+#pragma omp parallel for private (context)
+            for (size_t i = 0; i < queries.size(); i++) {
+                grid.radiusSearch(queries[i], radius_sq, context);
+            }
+        }));
+    }
+
+    if (opt.enabled("hash_grid_knn_in_radius")) {
+        writer.write("hash_grid_knn_in_radius", "k=10 r=" + toString(radius), n, t, opt.repeats, timeFunction(opt.repeats, [&]() {
+            cilantro::SearchContext<float> context;
+#pragma omp parallel for private (context)
+            for (size_t i = 0; i < queries.size(); i++) {
+                grid.kNNInRadiusSearch(queries[i], 10, radius_sq, context);
+            }
+        }));
+    }
+}
+
+// Per-bin seed hash of VoxelGrid::getRandomPointIndices (splitmix64 finalizer of the seed and the bin's
+// first point index), so that the rescan baseline picks the same points
+inline uint64_t hashBinSeed(uint64_t first_point, unsigned int seed = 0) {
+    uint64_t x = ((uint64_t)seed << 32) | first_point;
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30))*0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27))*0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+void benchVoxelGrid(const BenchmarkOptions &opt, BenchmarkWriter &writer, const cilantro::PointCloud &cloud, int t) {
+    // Bin size for ~10 points per occupied voxel
+    float bin_size = getRoomCloudRadius(cloud.size(), 10)*std::sqrt((float)M_PI);
+
+    if (opt.enabled("voxel_grid_build")) {
+        writer.write("voxel_grid_build", "bin=" + toString(bin_size), cloud.size(), t, opt.repeats, timeFunction(opt.repeats, [&]() {
+            cilantro::VoxelGrid vg(cloud, bin_size);
+            doNotOptimizeAway(vg);
+        }));
+    }
+
+    if (opt.enabled("voxel_grid_downsample")) {
+        cilantro::VoxelGrid vg(cloud, bin_size);
+        size_t num_out = 0;
+        std::pair<double,double> times = timeFunction(opt.repeats, [&]() {
+            cilantro::PointCloud res = vg.getDownsampledCloud();
+            num_out = res.size();
+        });
+        writer.write("voxel_grid_downsample", "bin=" + toString(bin_size), cloud.size(), t, opt.repeats, times, {{"output_points", (double)num_out}});
+    }
+
+    if (opt.enabled("voxel_grid_statistics")) {
+        // Means, covariances, closest-to-mean and random representatives: per-bin rescans through the bin
+        // lookup vs. one fused pass. The rescan picks the same random points (same per-bin seed hash); bins
+        // whose mean falls outside them through rounding are skipped and counted
+        cilantro::VoxelGrid vg(cloud, bin_size);
+        std::vector<Eigen::Vector3f> means;
+        std::vector<Eigen::Matrix3f> covariances;
+        std::vector<size_t> closest, random;
+        size_t num_missed = 0;
+        std::pair<double,double> times = timeFunction(opt.repeats, [&]() {
+            means = vg.getDownsampledPoints();
+            covariances.resize(means.size());
+            closest.resize(means.size());
+            random.resize(means.size());
+            num_missed = 0;
+#pragma omp parallel for reduction (+: num_missed)
+            for (size_t k = 0; k < means.size(); k++) {
+                size_t bin;
+                if (!vg.findBin(means[k], bin)) {
+                    num_missed++;
+                    continue;
+                }
+                const size_t num_bin_points = vg.getBinPointCount(bin);
+                const uint32_t * bin_points = vg.getBinPointIndices(bin);
+                Eigen::Matrix3f scatter(Eigen::Matrix3f::Zero());
+                float min_dist = std::numeric_limits<float>::infinity();
+                for (size_t i = 0; i < num_bin_points; i++) {
+                    const Eigen::Vector3f diff(cloud.points[bin_points[i]] - means[k]);
+                    scatter += diff*diff.transpose();
+                    if (diff.squaredNorm() < min_dist) {
+                        min_dist = diff.squaredNorm();
+                        closest[k] = bin_points[i];
+                    }
+                }
+                covariances[k] = scatter/(float)num_bin_points;
+                random[k] = bin_points[hashBinSeed(bin_points[0]) % num_bin_points];
+            }
+        });
+        writer.write("voxel_grid_statistics", "method=rescan bin=" + toString(bin_size), cloud.size(), t, opt.repeats, times, {{"output_points", (double)means.size()}, {"missed_bins", (double)num_missed}});
+        times = timeFunction(opt.repeats, [&]() {
+            vg.getDownsampledStatistics(&means, &covariances, &closest, &random);
+        });
+        writer.write("voxel_grid_statistics", "method=fused bin=" + toString(bin_size), cloud.size(), t, opt.repeats, times, {{"output_points", (double)means.size()}});
+    }
+}
+
+void benchVoxelMap(const BenchmarkOptions &opt, BenchmarkWriter &writer, const cilantro::PointCloud &cloud, int t) {
+    float bin_size = getRoomCloudRadius(cloud.size(), 10)*std::sqrt((float)M_PI);
+
+    // The cloud is streamed as num_frames interleaved frames, each seen from a slightly different pose
+    const size_t num_frames = 10;
+    std::vector<cilantro::PointCloud> frames(num_frames);
+    auto pose = [](size_t f) {
+        Eigen::Matrix4f res(Eigen::Matrix4f::Identity());
+        res.topLeftCorner(3,3) = Eigen::AngleAxisf(0.01f*f, Eigen::Vector3f::UnitZ()).toRotationMatrix();
+        res.topRightCorner(3,1) = Eigen::Vector3f(0.02f*f, 0.0f, 0.0f);
+        return res;
+    };
+    for (size_t f = 0; f < num_frames; f++) {
+        Eigen::Matrix4f pose_inv(pose(f).inverse());
+        Eigen::Matrix3f rot_inv(pose_inv.topLeftCorner(3,3));
+        Eigen::Vector3f t_inv(pose_inv.topRightCorner(3,1));
+        for (size_t i = f; i < cloud.size(); i += num_frames) {
+            frames[f].points.emplace_back(rot_inv*cloud.points[i] + t_inv);
+            frames[f].normals.emplace_back(rot_inv*cloud.normals[i]);
+            frames[f].colors.emplace_back(cloud.colors[i]);
+        }
+    }
+
+    if (opt.enabled("voxel_map_integrate")) {
+        // Map refreshed after every frame: incremental integration vs. re-gridding everything seen so far
+        size_t num_out = 0;
+        std::pair<double,double> times = timeFunction(opt.repeats, [&]() {
+            cilantro::PointCloud accumulated;
+            for (size_t f = 0; f < num_frames; f++) {
+                accumulated.append(frames[f].transformed(pose(f)));
+                num_out = cilantro::VoxelGrid(accumulated, bin_size).getDownsampledCloud().size();
+            }
+        });
+        writer.write("voxel_map_integrate", "method=voxel_grid_rebuild bin=" + toString(bin_size), cloud.size(), t, opt.repeats, times, {{"output_points", (double)num_out}});
+        times = timeFunction(opt.repeats, [&]() {
+            cilantro::VoxelMap map(bin_size);
+            for (size_t f = 0; f < num_frames; f++) {
+                num_out = map.integrate(frames[f], pose(f)).getCloud().size();
+            }
+        });
+        writer.write("voxel_map_integrate", "method=voxel_map bin=" + toString(bin_size), cloud.size(), t, opt.repeats, times, {{"output_points", (double)num_out}});
+    }
+
+    if (opt.enabled("voxel_map_evict")) {
+        cilantro::VoxelMap map(bin_size, true);
+        for (size_t f = 0; f < num_frames; f++) map.integrate(frames[f], pose(f));
+        size_t num_removed = 0;
+        std::pair<double,double> times = timeFunction(opt.repeats, [&]() {
+            cilantro::VoxelMap tmp(map);
+            num_removed = tmp.removeDistantVoxels(Eigen::Vector3f::Zero(), 1.0f);
+        });
+        writer.write("voxel_map_evict", "bin=" + toString(bin_size), cloud.size(), t, opt.repeats, times, {{"removed_voxels", (double)num_removed}});
+    }
+}
+
+void benchOctree(const BenchmarkOptions &opt, BenchmarkWriter &writer, const cilantro::PointCloud &cloud, int t) {
+    if (opt.enabled("octree_build")) {
+        writer.write("octree_build", "leaf_size=16", cloud.size(), t, opt.repeats, timeFunction(opt.repeats, [&]() {
+            cilantro::Octree octree(cloud);
+            doNotOptimizeAway(octree);
+        }));
+    }
+
+    cilantro::Octree octree(cloud);
+
+    if (opt.enabled("octree_knn")) {
+        cilantro::NeighborhoodSet<float> results;
+        writer.write("octree_knn", "k=10", cloud.size(), t, opt.repeats, timeFunction(opt.repeats, [&]() {
+            octree.kNNSearch(cloud.points, 10, results);
+        }));
+    }
+
+    if (opt.enabled("octree_box")) {
+        // Boxes covering about 1/1000 of the room volume, counted (whole nodes) and listed
+        std::vector<Eigen::Vector3f> corners = generateUniformPoints<float,3>(10000, 4);
+        size_t total = 0;
+        std::pair<double,double> times = timeFunction(opt.repeats, [&]() {
+            total = 0;
+            for (size_t i = 0; i < corners.size(); i++) {
+                total += octree.boxCount(corners[i], corners[i] + Eigen::Vector3f::Constant(0.1f));
+            }
+        });
+        writer.write("octree_box_count", "boxes=10000", cloud.size(), t, opt.repeats, times, {{"points", (double)total}});
+        writer.write("octree_box_search", "boxes=10000", cloud.size(), t, opt.repeats, timeFunction(opt.repeats, [&]() {
+            std::vector<size_t> indices;
+            for (size_t i = 0; i < corners.size(); i++) {
+                octree.boxSearch(corners[i], corners[i] + Eigen::Vector3f::Constant(0.1f), indices);
+            }
+        }));
+    }
+
+    if (opt.enabled("octree_lod")) {
+        // Timing comparison only: downsampling at five resolutions from one octree, against one VoxelGrid per
+        // resolution with the same cell size. Octree cells are aligned to the root cube and VoxelGrid bins to
+        // the minimum point, so the outputs differ (their sizes are reported)
+        size_t depths[] = {4, 5, 6, 7, 8};
+        size_t octree_cells = 0, voxel_grid_bins = 0;
+        std::pair<double,double> octree_times = timeFunction(opt.repeats, [&]() {
+            octree_cells = 0;
+            for (size_t d : depths) {
+                cilantro::PointCloud res = octree.getLevelOfDetailCloud(d);
+                octree_cells += res.size();
+                doNotOptimizeAway(res);
+            }
+        });
+        std::pair<double,double> voxel_grid_times = timeFunction(opt.repeats, [&]() {
+            voxel_grid_bins = 0;
+            for (size_t d : depths) {
+                cilantro::VoxelGrid vg(cloud, octree.getCellSize(d));
+                cilantro::PointCloud res = vg.getDownsampledCloud();
+                voxel_grid_bins += res.size();
+                doNotOptimizeAway(res);
+            }
+        });
+        writer.write("octree_lod", "depths=4-8 cells=root_cube_aligned", cloud.size(), t, opt.repeats, octree_times, {{"output_points", (double)octree_cells}});
+        writer.write("octree_lod_voxel_grid", "depths=4-8 cells=voxel_grid_aligned", cloud.size(), t, opt.repeats, voxel_grid_times, {{"output_points", (double)voxel_grid_bins}});
+    }
+}
+
+void benchMortonOrder(const BenchmarkOptions &opt, BenchmarkWriter &writer, const cilantro::PointCloud &cloud, int t) {
+    if (opt.enabled("morton_order_sort")) {
+        cilantro::PointCloud sorted;
+        writer.write("morton_order_sort", "bits=21", cloud.size(), t, opt.repeats, timeFunction(opt.repeats, [&]() {
+            sorted = cloud;
+        }, [&]() {
+            std::vector<size_t> permutation = cilantro::sortByMortonOrder(sorted);
+            doNotOptimizeAway(permutation);
+        }));
+    }
+
+    if (!opt.enabled("morton_order_knn") && !opt.enabled("morton_order_normal_estimation")) return;
+
+    // The same searches on the cloud in its input (random) order and after Morton sorting
+    cilantro::PointCloud sorted(cloud);
+    cilantro::sortByMortonOrder(sorted);
+    const cilantro::PointCloud * clouds[] = {&cloud, &sorted};
+    const char * order_names[] = {"input", "morton"};
+    for (size_t o = 0; o < 2; o++) {
+        const std::vector<Eigen::Vector3f> &points(clouds[o]->points);
+        cilantro::KDTree3D tree(points);
+        const std::string params = std::string("k=10 order=") + order_names[o];
+
+        if (opt.enabled("morton_order_knn")) {
+            cilantro::NeighborhoodSet<float> results;
+            writer.write("morton_order_knn", params, cloud.size(), t, opt.repeats, timeFunction(opt.repeats, [&]() {
+                tree.kNNSearch(points, 10, results);
+            }));
+        }
+
+        if (opt.enabled("morton_order_normal_estimation")) {
+            cilantro::NormalEstimation3D ne(points, tree);
+            writer.write("morton_order_normal_estimation", params, cloud.size(), t, opt.repeats, timeFunction(opt.repeats, [&]() {
+                std::vector<Eigen::Vector3f> normals = ne.estimateNormalsKNN(10);
+                doNotOptimizeAway(normals);
+            }));
+        }
+    }
+}
+
+void benchKDTreeSubset(const BenchmarkOptions &opt, BenchmarkWriter &writer, const cilantro::PointCloud &cloud, int t) {
+    if (!opt.enabled("kd_tree_subset")) return;
+
+    // Per-segment trees for 1000 spatially coherent segments (runs of the Morton order), built on a gathered
+    // copy of each segment or directly on the segment's indices, with a kNN search for each of its points
+    std::vector<size_t> order = cilantro::getMortonOrder(cloud.points);
+    size_t num_segments = std::min<size_t>(1000, cloud.size());
+    std::vector<std::vector<size_t> > segments(num_segments);
+    for (size_t i = 0; i < order.size(); i++) {
+        segments[i*num_segments/order.size()].emplace_back(order[i]);
+    }
+
+    std::pair<double,double> times = timeFunction(opt.repeats, [&]() {
+#pragma omp parallel for schedule(dynamic)
+        for (size_t s = 0; s < num_segments; s++) {
+            cilantro::PointCloud segment(cloud, segments[s]);
+            cilantro::KDTree3D tree(segment.points);
+            std::vector<size_t> neighbors;
+            std::vector<float> distances;
+            for (size_t i = 0; i < segment.size(); i++) {
+                tree.kNNSearch(segment.points[i], 5, neighbors, distances);
+            }
+            doNotOptimizeAway(neighbors);
+        }
+    });
+    writer.write("kd_tree_subset", "method=copy segments=" + toString(num_segments), cloud.size(), t, opt.repeats, times);
+
+    times = timeFunction(opt.repeats, [&]() {
+        cilantro::ConstDataMatrixMap<float,3> points(cloud.points);
+#pragma omp parallel for schedule(dynamic)
+        for (size_t s = 0; s < num_segments; s++) {
+            cilantro::KDTree3D tree(points, segments[s]);
+            std::vector<size_t> neighbors;
+            std::vector<float> distances;
+            for (size_t i = 0; i < segments[s].size(); i++) {
+                tree.kNNSearch(cloud.points[segments[s][i]], 5, neighbors, distances);
+            }
+            doNotOptimizeAway(neighbors);
+        }
+    });
+    writer.write("kd_tree_subset", "method=indices segments=" + toString(num_segments), cloud.size(), t, opt.repeats, times);
+}
+
+void benchNormalEstimation(const BenchmarkOptions &opt, BenchmarkWriter &writer, const cilantro::PointCloud &cloud, int t) {
+    cilantro::KDTree3D tree(cloud.points);
+    cilantro::NormalEstimation3D ne(cloud.points, tree);
+
+    if (opt.enabled("normal_estimation_knn")) {
+        writer.write("normal_estimation_knn", "k=10", cloud.size(), t, opt.repeats, timeFunction(opt.repeats, [&]() {
+            std::vector<Eigen::Vector3f> normals = ne.estimateNormalsKNN(10);
+            doNotOptimizeAway(normals);
+        }));
+    }
+
+    if (opt.enabled("normal_estimation_radius")) {
+        float radius = getRoomCloudRadius(cloud.size(), 20);
+        writer.write("normal_estimation_radius", "r=" + toString(radius), cloud.size(), t, opt.repeats, timeFunction(opt.repeats, [&]() {
+            std::vector<Eigen::Vector3f> normals = ne.estimateNormalsRadius(radius);
+            doNotOptimizeAway(normals);
+        }));
+    }
+
+    if (opt.enabled("normal_estimation_radius_hash_grid")) {
+        float radius = getRoomCloudRadius(cloud.size(), 20);
+        cilantro::HashGrid3D grid(cloud.points, radius);
+        cilantro::NormalEstimation<float,3,cilantro::HashGrid3D> ne_grid(cloud.points, grid);
+        writer.write("normal_estimation_radius_hash_grid", "r=" + toString(radius), cloud.size(), t, opt.repeats, timeFunction(opt.repeats, [&]() {
+            std::vector<Eigen::Vector3f> normals = ne_grid.estimateNormalsRadius(radius);
+            doNotOptimizeAway(normals);
+        }));
+    }
+}
+
+void benchNeighborhoodGraph(const BenchmarkOptions &opt, BenchmarkWriter &writer, const cilantro::PointCloud &cloud, int t) {
+    if (!opt.enabled("neighborhood_graph")) return;
+
+    // Normal estimation followed by segmentation on the same radius neighborhoods, searching in each stage
+    // versus sharing one precomputed graph
+    float radius = getRoomCloudRadius(cloud.size(), 10);
+    cilantro::Neighborhood<float> nh(cilantro::NeighborhoodType::RADIUS, 0, radius*radius);
+    cilantro::KDTree3D tree(cloud.points);
+    cilantro::PointCloud pipeline_cloud(cloud);
+    size_t num_segments = 0;
+
+    std::pair<double,double> times = timeFunction(opt.repeats, [&]() {
+        cilantro::NormalEstimation3D ne(pipeline_cloud.points, tree);
+        pipeline_cloud.normals = ne.estimateNormals(nh);
+        cilantro::ConnectedComponentSegmentation ccs(pipeline_cloud, tree);
+        ccs.segment(radius, (float)(10.0*M_PI/180.0), 0.2f, 100);
+        num_segments = ccs.getNumberOfSegments();
+    });
+    writer.write("neighborhood_graph_pipeline_search", "r=" + toString(radius), cloud.size(), t, opt.repeats, times, {{"segments", (double)num_segments}});
+
+    times = timeFunction(opt.repeats, [&]() {
+        cilantro::NeighborhoodGraph<float> graph(tree, nh);
+        cilantro::NormalEstimation3D ne(pipeline_cloud.points, graph);
+        pipeline_cloud.normals = ne.estimateNormals();
+        cilantro::ConnectedComponentSegmentation ccs(pipeline_cloud, graph);
+        ccs.segment(radius, (float)(10.0*M_PI/180.0), 0.2f, 100);
+        num_segments = ccs.getNumberOfSegments();
+    });
+    writer.write("neighborhood_graph_pipeline_shared", "r=" + toString(radius), cloud.size(), t, opt.repeats, times, {{"segments", (double)num_segments}});
+
+    writer.write("neighborhood_graph_build", "r=" + toString(radius), cloud.size(), t, opt.repeats, timeFunction(opt.repeats, [&]() {
+        cilantro::NeighborhoodGraph<float> graph(tree, nh);
+        doNotOptimizeAway(graph);
+    }));
+}
+
+void benchKMeans(const BenchmarkOptions &opt, BenchmarkWriter &writer, size_t n, int t) {
+    if (!opt.enabled("kmeans")) return;
+
+    std::vector<Eigen::Vector3f> points = generateUniformPoints<float,3>(n, 3);
+    // Deterministic initialization, a fixed number of iterations
+    std::vector<Eigen::Vector3f> centroids(points.begin(), points.begin() + std::min(n, (size_t)64));
+
+    bool use_tree[] = {false, true};
+    for (bool kd : use_tree) {
+        size_t iter = 0;
+        std::pair<double,double> times = timeFunction(opt.repeats, [&]() {
+            cilantro::KMeans3D km(points);
+            km.cluster(centroids, 20, 0.0f, kd);
+            iter = km.getPerformedIterationsCount();
+        });
+        writer.write("kmeans", "k=" + toString(centroids.size()) + " kd_tree=" + toString(kd), n, t, opt.repeats, times, {{"iterations", (double)iter}});
+    }
+}
+
+void benchIterativeClosestPoint(const BenchmarkOptions &opt, BenchmarkWriter &writer, const cilantro::PointCloud &dst, int t) {
+    if (!opt.enabled("icp")) return;
+
+    Eigen::Matrix3f rot;
+    rot = Eigen::AngleAxisf(0.05f, Eigen::Vector3f::UnitZ())*Eigen::AngleAxisf(-0.03f, Eigen::Vector3f::UnitX());
+    Eigen::Vector3f trans(0.02f, -0.01f, 0.015f);
+    cilantro::PointCloud src = generateRoomCloud(dst.size(), 0.001f, 5).transformed(rot, trans);
+
+    cilantro::IterativeClosestPoint::Metric metrics[] = {cilantro::IterativeClosestPoint::Metric::POINT_TO_POINT, cilantro::IterativeClosestPoint::Metric::POINT_TO_PLANE};
+    const char * metric_names[] = {"point_to_point", "point_to_plane"};
+    for (size_t m = 0; m < 2; m++) {
+        size_t iter = 0;
+        std::pair<double,double> times = timeFunction(opt.repeats, [&]() {
+            cilantro::IterativeClosestPoint icp(dst, src, metrics[m]);
+            icp.setMaxCorrespondenceDistance(0.1f).setConvergenceTolerance(0.0f).setMaxNumberOfIterations(10);
+            Eigen::Matrix3f r;
+            Eigen::Vector3f tr;
+            icp.getTransformation(r, tr);
+            iter = icp.getPerformedIterationsCount();
+        });
+        writer.write("icp", std::string("metric=") + metric_names[m] + " iter=10", dst.size(), t, opt.repeats, times, {{"iterations", (double)iter}});
+    }
+}
+
+void benchNormalDistributionsTransform(const BenchmarkOptions &opt, BenchmarkWriter &writer, const cilantro::PointCloud &dst, int t) {
+    if (!opt.enabled("ndt")) return;
+
+    // Same problem as the icp benchmark
+    Eigen::Matrix3f rot;
+    rot = Eigen::AngleAxisf(0.05f, Eigen::Vector3f::UnitZ())*Eigen::AngleAxisf(-0.03f, Eigen::Vector3f::UnitX());
+    Eigen::Vector3f trans(0.02f, -0.01f, 0.015f);
+    cilantro::PointCloud src = generateRoomCloud(dst.size(), 0.001f, 5).transformed(rot, trans);
+    Eigen::Matrix3f rot_gt(rot.transpose());
+    Eigen::Vector3f t_gt(-rot.transpose()*trans);
+
+    for (float res : {0.05f, 0.1f}) {
+        size_t iter = 0;
+        Eigen::Matrix3f r;
+        Eigen::Vector3f tr;
+        std::pair<double,double> times = timeFunction(opt.repeats, [&]() {
+            cilantro::NormalDistributionsTransform ndt(dst, src, res);
+            ndt.setConvergenceTolerance(0.0f).setMaxNumberOfIterations(10);
+            ndt.getTransformation(r, tr);
+            iter = ndt.getPerformedIterationsCount();
+        });
+        writer.write("ndt", "resolution=" + toString(res) + " iter=10", dst.size(), t, opt.repeats, times,
+                     {{"iterations", (double)iter}, {"rotation_error", (double)Eigen::AngleAxisf(r*rot_gt.transpose()).angle()}, {"translation_error", (double)(tr - t_gt).norm()}});
+    }
+}
+
+void benchPlaneEstimator(const BenchmarkOptions &opt, BenchmarkWriter &writer, const cilantro::PointCloud &cloud, int t) {
+    if (!opt.enabled("plane_estimator")) return;
+
+    // Unreachable inlier target, so that every run performs all iterations
+    writer.write("plane_estimator", "iter=100 thresh=0.005", cloud.size(), t, opt.repeats, timeFunction(opt.repeats, [&]() {
+        cilantro::PlaneEstimator pe(cloud);
+        pe.setMaxInlierResidual(0.005f).setTargetInlierCount(cloud.size()).setMaxNumberOfIterations(100);
+        cilantro::PlaneParameters plane = pe.getModelParameters();
+        doNotOptimizeAway(plane);
+    }));
+}
+
+void benchConnectedComponentSegmentation(const BenchmarkOptions &opt, BenchmarkWriter &writer, const cilantro::PointCloud &cloud, int t) {
+    if (!opt.enabled("connected_component_segmentation")) return;
+
+    float radius = getRoomCloudRadius(cloud.size(), 10);
+    cilantro::KDTree3D tree(cloud.points);
+    size_t num_segments = 0;
+    std::pair<double,double> times = timeFunction(opt.repeats, [&]() {
+        cilantro::ConnectedComponentSegmentation ccs(cloud, tree);
+        ccs.segment(radius, (float)(10.0*M_PI/180.0), 0.2f, 100);
+        num_segments = ccs.getNumberOfSegments();
+    });
+    writer.write("connected_component_segmentation", "r=" + toString(radius), cloud.size(), t, opt.repeats, times, {{"segments", (double)num_segments}});
+
+    cilantro::HashGrid3D grid(cloud.points, radius);
+    times = timeFunction(opt.repeats, [&]() {
+        cilantro::GenericConnectedComponentSegmentation<cilantro::HashGrid3D> ccs(cloud, grid);
+        ccs.segment(radius, (float)(10.0*M_PI/180.0), 0.2f, 100);
+        num_segments = ccs.getNumberOfSegments();
+    });
+    writer.write("connected_component_segmentation_hash_grid", "r=" + toString(radius), cloud.size(), t, opt.repeats, times, {{"segments", (double)num_segments}});
+}
+
+void printUsage(const char * name) {
+    std::cerr << "Usage: " << name << " [options]" << std::endl
+              << "  --sizes N1,N2,...      point counts to sweep (default: 10000,100000)" << std::endl
+              << "  --threads T1,T2,...    OpenMP thread counts to sweep (default: 1)" << std::endl
+              << "  --repeats R            timed repetitions per measurement (default: 3)" << std::endl
+              << "  --format csv|json      output format (default: csv)" << std::endl
+              << "  --filter SUBSTRING     only run benchmarks whose name contains SUBSTRING" << std::endl
+              << "  --output FILE          write results to FILE instead of stdout" << std::endl;
+}
+
+int main(int argc, char ** argv) {
+    BenchmarkOptions opt;
+    opt.threads = {getMaxNumberOfThreads()};
+    std::string output_file;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "--help" || arg == "-h") {
+            printUsage(argv[0]);
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        std::string val(argv[++i]);
+        if (arg == "--sizes") opt.sizes = parseList<size_t>(val);
+        else if (arg == "--threads") opt.threads = parseList<int>(val);
+        else if (arg == "--repeats") opt.repeats = parseList<size_t>(val)[0];
+        else if (arg == "--format") opt.format = val;
+        else if (arg == "--filter") opt.filter = val;
+        else if (arg == "--output") output_file = val;
+        else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::ofstream file_out;
+    if (!output_file.empty()) file_out.open(output_file);
+    BenchmarkWriter writer(output_file.empty() ? std::cout : file_out, opt.format);
+
+    for (size_t n : opt.sizes) {
+        cilantro::PointCloud room = generateRoomCloud(n);
+        for (int t : opt.threads) {
+            setNumberOfThreads(t);
+            benchKDTree(opt, writer, n, t);
+            benchKDTreeL2Vectorized<3>(opt, writer, n, t);
+            benchKDTreeL2Vectorized<6>(opt, writer, n, t);
+            benchKDTreeL2Vectorized<9>(opt, writer, n, t);
+            benchDynamicKDTree(opt, writer, n, t);
+            benchKDForest(opt, writer, n, t);
+            benchConcurrentKDTree(opt, writer, n, t);
+            benchHashGrid(opt, writer, n, t);
+            benchVoxelGrid(opt, writer, room, t);
+            benchVoxelMap(opt, writer, room, t);
+            benchOctree(opt, writer, room, t);
+            benchMortonOrder(opt, writer, room, t);
+            benchKDTreeSubset(opt, writer, room, t);
+            benchNormalEstimation(opt, writer, room, t);
+            benchKMeans(opt, writer, n, t);
+            benchIterativeClosestPoint(opt, writer, room, t);
+            benchNormalDistributionsTransform(opt, writer, room, t);
+            benchPlaneEstimator(opt, writer, room, t);
+            benchConnectedComponentSegmentation(opt, writer, room, t);
+            benchNeighborhoodGraph(opt, writer, room, t);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <random>
+#include <cilantro/point_cloud.hpp>
+
+namespace cilantro_bench {
+    // Uniformly distributed points in the [0,1]^EigenDim hypercube
+    template <typename ScalarT, ptrdiff_t EigenDim>
+    std::vector<Eigen::Matrix<ScalarT,EigenDim,1> > generateUniformPoints(size_t num_points, unsigned int seed = 0) {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<ScalarT> dist(0, 1);
+        std::vector<Eigen::Matrix<ScalarT,EigenDim,1> > points(num_points);
+        for (size_t i = 0; i < num_points; i++) {
+            for (ptrdiff_t j = 0; j < EigenDim; j++) {
+                points[i][j] = dist(rng);
+            }
+        }
+        return points;
+    }
+
+    // Surface samples of a unit "room" (the six faces of [0,1]^3) that contains a sphere, with normals and
+    // colors. Sampling is area-proportional, so point density is constant over all surfaces.
+    inline cilantro::PointCloud generateRoomCloud(size_t num_points, float noise_std = 0.001f, unsigned int seed = 0) {
+        const Eigen::Vector3f sphere_center(0.5f, 0.5f, 0.35f);
+        const float sphere_radius = 0.2f;
+        const float cube_area = 6.0f;
+        const float sphere_area = 4.0f*(float)M_PI*sphere_radius*sphere_radius;
+
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+        std::normal_distribution<float> gaussian(0.0f, 1.0f);
+
+        cilantro::PointCloud cloud;
+        cloud.points.resize(num_points);
+        cloud.normals.resize(num_points);
+        cloud.colors.resize(num_points);
+
+        for (size_t i = 0; i < num_points; i++) {
+            Eigen::Vector3f pt, n, c;
+            if (uniform(rng)*(cube_area + sphere_area) < cube_area) {
+                int face = std::min((int)(uniform(rng)*6.0f), 5);
+                int axis = face/2;
+                float u = uniform(rng), v = uniform(rng);
+                pt[axis] = (float)(face%2);
+                pt[(axis+1)%3] = u;
+                pt[(axis+2)%3] = v;
+                n.setZero();
+                n[axis] = (face%2 == 0) ? 1.0f : -1.0f;
+                c = Eigen::Vector3f(0.2f + 0.1f*face, 0.8f - 0.1f*face, 0.5f);
+            } else {
+                n = Eigen::Vector3f(gaussian(rng), gaussian(rng), gaussian(rng)).normalized();
+                pt = sphere_center + sphere_radius*n;
+                c = Eigen::Vector3f(0.9f, 0.1f, 0.1f);
+            }
+            cloud.points[i] = pt + noise_std*Eigen::Vector3f(gaussian(rng), gaussian(rng), gaussian(rng));
+            cloud.normals[i] = n;
+            cloud.colors[i] = (c + 0.02f*Eigen::Vector3f(gaussian(rng), gaussian(rng), gaussian(rng))).cwiseMax(0.0f).cwiseMin(1.0f);
+        }
+
+        return cloud;
+    }
+
+    // Total surface area of the room cloud above; used to pick radii for a target neighborhood size
+    inline float getRoomCloudSurfaceArea() {
+        return 6.0f + 4.0f*(float)M_PI*0.2f*0.2f;
+    }
+
+    // Search radius that yields roughly num_neighbors neighbors on a room cloud of num_points points
+    inline float getRoomCloudRadius(size_t num_points, size_t num_neighbors) {
+        return std::sqrt(num_neighbors*getRoomCloudSurfaceArea()/((float)M_PI*num_points));
+    }
+}
@@ -1,21 +1,31 @@
 #pragma once
 
 #include <cilantro/colormap.hpp>
+#include <cilantro/concurrent_kd_tree.hpp>
 #include <cilantro/connected_component_segmentation.hpp>
 #include <cilantro/convex_hull.hpp>
 #include <cilantro/convex_hull_utilities.hpp>
 #include <cilantro/convex_polytope.hpp>
 #include <cilantro/data_matrix_map.hpp>
+#include <cilantro/dynamic_kd_tree.hpp>
+#include <cilantro/hash_grid.hpp>
 #include <cilantro/image_point_cloud_conversions.hpp>
 #include <cilantro/image_viewer.hpp>
 #include <cilantro/io.hpp>
 #include <cilantro/iterative_closest_point.hpp>
+#include <cilantro/kd_forest.hpp>
 #include <cilantro/kd_tree.hpp>
 #include <cilantro/kmeans.hpp>
+#include <cilantro/morton_order.hpp>
+#include <cilantro/neighborhood_graph.hpp>
+#include <cilantro/neighborhood_search.hpp>
+#include <cilantro/normal_distributions_transform.hpp>
 #include <cilantro/normal_estimation.hpp>
+#include <cilantro/octree.hpp>
 #include <cilantro/plane_estimator.hpp>
 #include <cilantro/point_cloud.hpp>
 #include <cilantro/principal_component_analysis.hpp>
+#include <cilantro/radix_sort.hpp>
 #include <cilantro/random_sample_consensus.hpp>
 #include <cilantro/renderables.hpp>
 #include <cilantro/rigid_transform_estimator.hpp>
@@ -24,3 +34,4 @@
 #include <cilantro/visualizer.hpp>
 #include <cilantro/visualizer_handler.hpp>
 #include <cilantro/voxel_grid.hpp>
+#include <cilantro/voxel_map.hpp>
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <cilantro/kd_tree.hpp>
+
+namespace cilantro {
+    // Shared handle to a KDTree that can be replaced while other threads are searching it (read-copy-update).
+    // Every update builds a new immutable snapshot (a tree over its own copy of the points) in the updating
+    // thread and publishes it atomically; readers take the current snapshot and keep searching it for as long
+    // as they hold it. Replaced snapshots are retired and freed by a later update (or reclaim()) once no reader
+    // holds them, so readers never pay for freeing a tree.
+    // Readers never wait for a tree to be built, but taking a snapshot is not lock-free: the shared_ptr atomics
+    // (std::atomic_load/atomic_exchange) are implemented by libstdc++ with a small global pool of mutexes, held
+    // only for the duration of the pointer copy. Each search on the handle takes one snapshot (a batched search
+    // takes one for the whole batch); threads issuing many single-query searches should hold a snapshot from
+    // getSnapshot() and search its tree directly.
+    template <typename ScalarT, ptrdiff_t EigenDim, template <class> class DistAdaptor>
+    class ConcurrentKDTree : public NeighborhoodSearchBase<ConcurrentKDTree<ScalarT,EigenDim,DistAdaptor>,ScalarT,EigenDim> {
+    public:
+        typedef NeighborhoodSearchBase<ConcurrentKDTree<ScalarT,EigenDim,DistAdaptor>,ScalarT,EigenDim> Base;
+
+        using Base::search;
+
+        class Snapshot {
+        public:
+            EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+            Snapshot(const ConstDataMatrixMap<ScalarT,EigenDim> &points, size_t max_leaf_size, bool flat_layout, size_t version)
+                    : points_(points),
+                      tree_(points_, max_leaf_size, flat_layout),
+                      version_(version)
+            {}
+
+            inline const Eigen::Matrix<ScalarT,EigenDim,Eigen::Dynamic>& getPoints() const { return points_; }
+            inline const KDTree<ScalarT,EigenDim,DistAdaptor>& getTree() const { return tree_; }
+
+            // Number of updates published before this snapshot
+            inline size_t getVersion() const { return version_; }
+
+        private:
+            Eigen::Matrix<ScalarT,EigenDim,Eigen::Dynamic> points_;
+            KDTree<ScalarT,EigenDim,DistAdaptor> tree_;
+            size_t version_;
+        };
+
+        typedef std::shared_ptr<const Snapshot> SnapshotPtr;
+
+        ConcurrentKDTree(size_t max_leaf_size = 10, bool flat_layout = false)
+                : max_leaf_size_(max_leaf_size),
+                  flat_layout_(flat_layout),
+                  snapshot_(new Snapshot(Eigen::Matrix<ScalarT,EigenDim,Eigen::Dynamic>(EigenDim, 0), max_leaf_size, flat_layout, 0))
+        {}
+
+        ConcurrentKDTree(const ConstDataMatrixMap<ScalarT,EigenDim> &points, size_t max_leaf_size = 10, bool flat_layout = false)
+                : max_leaf_size_(max_leaf_size),
+                  flat_layout_(flat_layout),
+                  snapshot_(new Snapshot(points, max_leaf_size, flat_layout, 0))
+        {}
+
+        ~ConcurrentKDTree() {}
+
+        // Current snapshot; searches on it stay valid (and see the same data) for as long as it is held
+        inline SnapshotPtr getSnapshot() const { return std::atomic_load(&snapshot_); }
+
+        inline size_t getVersion() const { return getSnapshot()->getVersion(); }
+
+        // Builds a tree over a copy of points and publishes it; concurrent updates are serialized, and readers
+        // keep using the previous snapshot while the new tree is built
+        void update(const ConstDataMatrixMap<ScalarT,EigenDim> &points) {
+            std::lock_guard<std::mutex> lock(update_mutex_);
+            SnapshotPtr next(new Snapshot(points, max_leaf_size_, flat_layout_, std::atomic_load(&snapshot_)->getVersion() + 1));
+            retired_.emplace_back(std::atomic_exchange(&snapshot_, next));
+            reclaim_retired_();
+        }
+
+        // Frees the retired snapshots that are no longer held by any reader; returns how many remain
+        size_t reclaim() {
+            std::lock_guard<std::mutex> lock(update_mutex_);
+            reclaim_retired_();
+            return retired_.size();
+        }
+
+        // Searches on the current snapshot; the handle can be used wherever a KDTree is searched
+        inline void nearestNeighborSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t &neighbor, ScalarT &distance, ScalarT eps = 0) const {
+            getSnapshot()->getTree().nearestNeighborSearch(query_pt, neighbor, distance, eps);
+        }
+
+        inline void kNNSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t k, std::vector<size_t> &neighbors, std::vector<ScalarT> &distances, ScalarT eps = 0) const {
+            getSnapshot()->getTree().kNNSearch(query_pt, k, neighbors, distances, eps);
+        }
+
+        inline void radiusSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, ScalarT radius, std::vector<size_t> &neighbors, std::vector<ScalarT> &distances, ScalarT eps = 0) const {
+            getSnapshot()->getTree().radiusSearch(query_pt, radius, neighbors, distances, eps);
+        }
+
+        inline void kNNInRadiusSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t k, ScalarT radius, std::vector<size_t> &neighbors, std::vector<ScalarT> &distances, ScalarT eps = 0) const {
+            getSnapshot()->getTree().kNNInRadiusSearch(query_pt, k, radius, neighbors, distances, eps);
+        }
+
+        inline void kNNSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t k, SearchContext<ScalarT> &context, ScalarT eps = 0) const {
+            getSnapshot()->getTree().kNNSearch(query_pt, k, context, eps);
+        }
+
+        inline void radiusSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, ScalarT radius, SearchContext<ScalarT> &context, ScalarT eps = 0) const {
+            getSnapshot()->getTree().radiusSearch(query_pt, radius, context, eps);
+        }
+
+        inline void kNNInRadiusSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t k, ScalarT radius, SearchContext<ScalarT> &context, ScalarT eps = 0) const {
+            getSnapshot()->getTree().kNNInRadiusSearch(query_pt, k, radius, context, eps);
+        }
+
+        // Batched searches see a single snapshot for all queries
+        inline void kNNSearch(const ConstDataMatrixMap<ScalarT,EigenDim> &queries, size_t k, NeighborhoodSet<ScalarT> &results, ScalarT eps = 0) const {
+            getSnapshot()->getTree().kNNSearch(queries, k, results, eps);
+        }
+
+        inline void radiusSearch(const ConstDataMatrixMap<ScalarT,EigenDim> &queries, ScalarT radius, NeighborhoodSet<ScalarT> &results, ScalarT eps = 0) const {
+            getSnapshot()->getTree().radiusSearch(queries, radius, results, eps);
+        }
+
+        inline void kNNInRadiusSearch(const ConstDataMatrixMap<ScalarT,EigenDim> &queries, size_t k, ScalarT radius, NeighborhoodSet<ScalarT> &results, ScalarT eps = 0) const {
+            getSnapshot()->getTree().kNNInRadiusSearch(queries, k, radius, results, eps);
+        }
+
+    private:
+        size_t max_leaf_size_;
+        bool flat_layout_;
+        SnapshotPtr snapshot_;
+        std::mutex update_mutex_;
+        std::vector<SnapshotPtr> retired_;
+
+        // A retired snapshot can no longer be acquired, so once the retired list holds its only reference,
+        // no reader can still be using it
+        void reclaim_retired_() {
+            size_t num_kept = 0;
+            for (size_t i = 0; i < retired_.size(); i++) {
+                if (retired_[i].use_count() > 1) retired_[num_kept++].swap(retired_[i]);
+            }
+            retired_.resize(num_kept);
+        }
+    };
+
+    typedef ConcurrentKDTree<float,2,KDTreeDistanceAdaptors::L2> ConcurrentKDTree2D;
+    typedef ConcurrentKDTree<float,3,KDTreeDistanceAdaptors::L2> ConcurrentKDTree3D;
+}
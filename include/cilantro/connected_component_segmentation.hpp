@@ -1,42 +1,221 @@
 #pragma once
 
+#include <set>
 #include <cilantro/kd_tree.hpp>
+#include <cilantro/neighborhood_graph.hpp>
 #include <cilantro/point_cloud.hpp>
 
 namespace cilantro {
-    class ConnectedComponentSegmentation {
+    // Region growing over radius neighborhoods; SearchIndexT is the 3D neighbor index used for the radius
+    // queries (e.g. KDTree3D or HashGrid3D), and is only built internally if it can be constructed from the points.
+    // Given a precomputed NeighborhoodGraph over the same points instead, region growing follows the graph
+    // edges that are within the distance threshold and no searches are performed.
+    template <class SearchIndexT>
+    class GenericConnectedComponentSegmentation {
     public:
         EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
-        ConnectedComponentSegmentation(const std::vector<Eigen::Vector3f> &points, const std::vector<Eigen::Vector3f> &normals, const std::vector<Eigen::Vector3f> &colors);
-        ConnectedComponentSegmentation(const std::vector<Eigen::Vector3f> &points, const std::vector<Eigen::Vector3f> &normals, const std::vector<Eigen::Vector3f> &colors, const KDTree3D &kd_tree);
-        ConnectedComponentSegmentation(const PointCloud &cloud);
-        ConnectedComponentSegmentation(const PointCloud &cloud, const KDTree3D &kd_tree);
-        ~ConnectedComponentSegmentation();
-
-        ConnectedComponentSegmentation& segment(std::vector<size_t> seeds_ind,
-                                                float dist_thresh,
-                                                float normal_angle_thresh,
-                                                float color_diff_thresh,
-                                                size_t min_segment_size = 0,
-                                                size_t max_segment_size = std::numeric_limits<size_t>::max());
-        ConnectedComponentSegmentation& segment(float dist_thresh,
-                                                float normal_angle_thresh,
-                                                float color_diff_thresh,
-                                                size_t min_segment_size = 0,
-                                                size_t max_segment_size = std::numeric_limits<size_t>::max());
+        GenericConnectedComponentSegmentation(const std::vector<Eigen::Vector3f> &points, const std::vector<Eigen::Vector3f> &normals, const std::vector<Eigen::Vector3f> &colors)
+                : points_(&points),
+                  normals_((normals.size() == points.size()) ? &normals : NULL),
+                  colors_((colors.size() == points.size()) ? &colors : NULL),
+                  search_index_(new SearchIndexT(points)),
+                  search_index_owned_(true),
+                  graph_(NULL)
+        {}
+
+        GenericConnectedComponentSegmentation(const std::vector<Eigen::Vector3f> &points, const std::vector<Eigen::Vector3f> &normals, const std::vector<Eigen::Vector3f> &colors, const SearchIndexT &search_index)
+                : points_(&points),
+                  normals_((normals.size() == points.size()) ? &normals : NULL),
+                  colors_((colors.size() == points.size()) ? &colors : NULL),
+                  search_index_((SearchIndexT*)&search_index),
+                  search_index_owned_(false),
+                  graph_(NULL)
+        {}
+
+        GenericConnectedComponentSegmentation(const PointCloud &cloud)
+                : points_(&cloud.points),
+                  normals_((cloud.normals.size() == cloud.points.size()) ? &cloud.normals : NULL),
+                  colors_((cloud.colors.size() == cloud.points.size()) ? &cloud.colors : NULL),
+                  search_index_(new SearchIndexT(cloud.points)),
+                  search_index_owned_(true),
+                  graph_(NULL)
+        {}
+
+        GenericConnectedComponentSegmentation(const PointCloud &cloud, const SearchIndexT &search_index)
+                : points_(&cloud.points),
+                  normals_((cloud.normals.size() == cloud.points.size()) ? &cloud.normals : NULL),
+                  colors_((cloud.colors.size() == cloud.points.size()) ? &cloud.colors : NULL),
+                  search_index_((SearchIndexT*)&search_index),
+                  search_index_owned_(false),
+                  graph_(NULL)
+        {}
+
+        GenericConnectedComponentSegmentation(const std::vector<Eigen::Vector3f> &points, const std::vector<Eigen::Vector3f> &normals, const std::vector<Eigen::Vector3f> &colors, const NeighborhoodGraph<float> &graph)
+                : points_(&points),
+                  normals_((normals.size() == points.size()) ? &normals : NULL),
+                  colors_((colors.size() == points.size()) ? &colors : NULL),
+                  search_index_(NULL),
+                  search_index_owned_(false),
+                  graph_(&graph)
+        {}
+
+        GenericConnectedComponentSegmentation(const PointCloud &cloud, const NeighborhoodGraph<float> &graph)
+                : points_(&cloud.points),
+                  normals_((cloud.normals.size() == cloud.points.size()) ? &cloud.normals : NULL),
+                  colors_((cloud.colors.size() == cloud.points.size()) ? &cloud.colors : NULL),
+                  search_index_(NULL),
+                  search_index_owned_(false),
+                  graph_(&graph)
+        {}
+
+        ~GenericConnectedComponentSegmentation() {
+            if (search_index_owned_) delete search_index_;
+        }
+
+        std::vector<size_t> getUnlabeledPointIndices() const {
+            std::vector<size_t> res;
+            res.reserve(label_map_.size());
+            size_t no_label = component_indices_.size();
+            for (size_t i = 0; i < label_map_.size(); i++) {
+                if (label_map_[i] == no_label) res.emplace_back(i);
+            }
+            return res;
+        }
+
+        GenericConnectedComponentSegmentation& segment(std::vector<size_t> seeds_ind,
+                                                       float dist_thresh,
+                                                       float normal_angle_thresh,
+                                                       float color_diff_thresh,
+                                                       size_t min_segment_size = 0,
+                                                       size_t max_segment_size = std::numeric_limits<size_t>::max())
+        {
+            float radius_sq = dist_thresh*dist_thresh;
+
+            normal_angle_thresh_ = normal_angle_thresh;
+            color_diff_thresh_sq_ = color_diff_thresh*color_diff_thresh;
+
+            const size_t unassigned = std::numeric_limits<size_t>::max();
+            std::vector<size_t> current_label(points_->size(), unassigned);
+
+            std::vector<size_t> frontier_set;
+            frontier_set.reserve(points_->size());
+
+//        std::vector<std::set<size_t> > ind_per_seed(seeds_ind.size());
+            std::vector<std::vector<size_t> > ind_per_seed(seeds_ind.size());
+            std::vector<std::set<size_t> > seeds_to_merge_with(seeds_ind.size());
+
+            SearchContext<float> context;
+
+#pragma omp parallel for shared (seeds_ind, current_label, ind_per_seed, seeds_to_merge_with) private (context, frontier_set)
+            for (size_t i = 0; i < seeds_ind.size(); i++) {
+                if (current_label[seeds_ind[i]] != unassigned) continue;
+
+                seeds_to_merge_with[i].insert(i);
+
+                frontier_set.clear();
+                frontier_set.emplace_back(seeds_ind[i]);
+
+                current_label[seeds_ind[i]] = i;
+
+                while (!frontier_set.empty()) {
+                    size_t curr_seed = frontier_set[frontier_set.size()-1];
+                    frontier_set.resize(frontier_set.size()-1);
+
+//                ind_per_seed[i].insert(curr_seed);
+                    ind_per_seed[i].emplace_back(curr_seed);
+
+                    const size_t * neighbors;
+                    const float * distances;
+                    size_t num_neighbors;
+                    if (graph_ != NULL) {
+                        neighbors = graph_->getNeighborIndices(curr_seed);
+                        distances = graph_->getNeighborDistances(curr_seed);
+                        num_neighbors = graph_->getNeighborhoodSize(curr_seed);
+                    } else {
+                        search_index_->radiusSearch((*points_)[curr_seed], radius_sq, context);
+                        neighbors = context.neighbors.data();
+                        distances = context.distances.data();
+                        num_neighbors = context.neighbors.size();
+                    }
+                    for (size_t j = 0; j < num_neighbors; j++) {
+                        if (neighbors[j] == curr_seed || distances[j] > radius_sq) continue;
+                        const size_t& curr_lbl = current_label[neighbors[j]];
+                        if (curr_lbl == i || is_similar_(curr_seed, neighbors[j])) {
+                            if (curr_lbl == unassigned) {
+                                frontier_set.emplace_back(neighbors[j]);
+                                current_label[neighbors[j]] = i;
+                            } else {
+                                if (curr_lbl != i) seeds_to_merge_with[i].insert(curr_lbl);
+                            }
+                        }
+                    }
+                }
+
+            }
+
+            for (size_t i = 0; i < seeds_to_merge_with.size(); i++) {
+                for (auto it = seeds_to_merge_with[i].begin(); it != seeds_to_merge_with[i].end(); ++it) {
+                    if (*it > i) seeds_to_merge_with[*it].insert(i);
+                }
+            }
+
+            component_indices_.clear();
+            for (size_t i = seeds_to_merge_with.size(); i-- > 0;) {
+                if (seeds_to_merge_with[i].empty()) continue;
+                size_t min_seed_ind = *seeds_to_merge_with[i].begin();
+                if (min_seed_ind < i) {
+                    for (auto it = seeds_to_merge_with[i].begin(); it != seeds_to_merge_with[i].end(); ++it) {
+                        if (*it < i) seeds_to_merge_with[*it].insert(seeds_to_merge_with[i].begin(), seeds_to_merge_with[i].end());
+                    }
+//                seeds_to_merge_with[i].clear();
+                } else {
+                    std::set<size_t> curr_cc_ind;
+                    for (auto it = seeds_to_merge_with[i].begin(); it != seeds_to_merge_with[i].end(); ++it) {
+                        curr_cc_ind.insert(ind_per_seed[*it].begin(), ind_per_seed[*it].end());
+                    }
+                    if (curr_cc_ind.size() >= min_segment_size && curr_cc_ind.size() <= max_segment_size) {
+                        component_indices_.emplace_back(curr_cc_ind.begin(), curr_cc_ind.end());
+                    }
+                }
+            }
+
+            std::sort(component_indices_.begin(), component_indices_.end(), vector_size_comparator_);
+
+            label_map_ = std::vector<size_t>(points_->size(), component_indices_.size());
+            for (size_t i = 0; i < component_indices_.size(); i++) {
+                for (size_t j = 0; j < component_indices_[i].size(); j++) {
+                    label_map_[component_indices_[i][j]] = i;
+                }
+            }
+
+            return *this;
+        }
+
+        GenericConnectedComponentSegmentation& segment(float dist_thresh,
+                                                       float normal_angle_thresh,
+                                                       float color_diff_thresh,
+                                                       size_t min_segment_size = 0,
+                                                       size_t max_segment_size = std::numeric_limits<size_t>::max())
+        {
+            std::vector<size_t> seeds_ind(points_->size());
+            for (size_t i = 0; i < seeds_ind.size(); i++) {
+                seeds_ind[i] = i;
+            }
+            return segment(seeds_ind, dist_thresh, normal_angle_thresh, color_diff_thresh, min_segment_size, max_segment_size);
+        }
 
         inline const std::vector<std::vector<size_t> >& getComponentPointIndices() const { return component_indices_; }
         inline const std::vector<size_t>& getComponentIndexMap() const { return label_map_; }
-        std::vector<size_t> getUnlabeledPointIndices() const;
         inline size_t getNumberOfSegments() const { return component_indices_.size(); }
 
     private:
         const std::vector<Eigen::Vector3f> *points_;
         const std::vector<Eigen::Vector3f> *normals_;
         const std::vector<Eigen::Vector3f> *colors_;
-        KDTree3D *kd_tree_;
-        bool kd_tree_owned_;
+        SearchIndexT *search_index_;
+        bool search_index_owned_;
+        const NeighborhoodGraph<float> *graph_;
 
         float normal_angle_thresh_;
         float color_diff_thresh_sq_;
@@ -59,4 +238,14 @@ namespace cilantro {
 
         static inline bool vector_size_comparator_(const std::vector<size_t> &a, const std::vector<size_t> &b) { return a.size() > b.size(); }
     };
+
+    // The KDTree3D instantiation is compiled once, in the library
+    extern template class GenericConnectedComponentSegmentation<KDTree3D>;
+
+    class ConnectedComponentSegmentation : public GenericConnectedComponentSegmentation<KDTree3D> {
+    public:
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        using GenericConnectedComponentSegmentation<KDTree3D>::GenericConnectedComponentSegmentation;
+    };
 }
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <memory>
+#include <cilantro/kd_tree.hpp>
+
+namespace cilantro {
+    // KD-tree that supports incremental point insertion and removal (logarithmic method). Points are stored
+    // in a forest of static KDTrees whose sizes decrease geometrically; a batch insertion builds a new tree
+    // that absorbs all trees not more than twice its size, so every point is rebuilt O(log n) times overall.
+    // Removal is lazy (removed points are skipped during search and dropped on the next rebuild that touches
+    // them); the forest is compacted when more than half of the stored points have been removed.
+    // Points are identified by ids assigned consecutively in insertion order; ids are never reused.
+    template <typename ScalarT, ptrdiff_t EigenDim, template <class> class DistAdaptor>
+    class DynamicKDTree : public NeighborhoodSearchBase<DynamicKDTree<ScalarT,EigenDim,DistAdaptor>,ScalarT,EigenDim> {
+    public:
+        typedef NeighborhoodSearchBase<DynamicKDTree<ScalarT,EigenDim,DistAdaptor>,ScalarT,EigenDim> Base;
+        typedef typename Base::NeighborhoodType NeighborhoodType;
+        typedef typename Base::Neighborhood Neighborhood;
+
+        using Base::search;
+        using Base::kNNSearch;
+        using Base::radiusSearch;
+        using Base::kNNInRadiusSearch;
+
+        DynamicKDTree(size_t max_leaf_size = 10) : max_leaf_size_(max_leaf_size), num_active_(0), num_stored_(0) {}
+
+        DynamicKDTree(const ConstDataMatrixMap<ScalarT,EigenDim> &data, size_t max_leaf_size = 10)
+                : max_leaf_size_(max_leaf_size), num_active_(0), num_stored_(0)
+        {
+            addPoints(data);
+        }
+
+        ~DynamicKDTree() {}
+
+        // Returns the id of the first inserted point; the batch gets ids [first, first + points.cols())
+        size_t addPoints(const ConstDataMatrixMap<ScalarT,EigenDim> &points) {
+            size_t first_id = removed_.size();
+            size_t num_new = points.cols();
+            if (num_new == 0) return first_id;
+            removed_.resize(first_id + num_new, false);
+
+            // Absorb the trailing trees that are not more than twice the size of the new one
+            std::vector<std::unique_ptr<Tree_> > absorbed;
+            size_t num_absorbed = 0;
+            while (!trees_.empty() && trees_.back()->ids.size() <= 2*(num_new + num_absorbed)) {
+                num_absorbed += trees_.back()->ids.size();
+                absorbed.emplace_back(std::move(trees_.back()));
+                trees_.pop_back();
+            }
+            trees_.emplace_back(build_tree_(points, first_id, absorbed));
+            num_active_ += num_new;
+            return first_id;
+        }
+
+        inline size_t addPoint(const Eigen::Matrix<ScalarT,EigenDim,1> &point) {
+            return addPoints(ConstDataMatrixMap<ScalarT,EigenDim>(point.data(), 1));
+        }
+
+        // Returns the number of points that were actually removed (unknown or already removed ids are ignored)
+        size_t removePoints(const std::vector<size_t> &ids) {
+            size_t num_removed = 0;
+            for (size_t i = 0; i < ids.size(); i++) {
+                if (ids[i] < removed_.size() && !removed_[ids[i]]) {
+                    removed_[ids[i]] = true;
+                    num_removed++;
+                }
+            }
+            num_active_ -= num_removed;
+            if (num_stored_ > 2*num_active_) {
+                // Rebuild a single tree from the remaining points
+                std::vector<std::unique_ptr<Tree_> > absorbed(std::move(trees_));
+                trees_.clear();
+                if (num_active_ > 0) trees_.emplace_back(build_tree_(ConstDataMatrixMap<ScalarT,EigenDim>(NULL, 0), 0, absorbed));
+                num_stored_ = num_active_;
+            }
+            return num_removed;
+        }
+
+        inline bool removePoint(size_t id) { return removePoints(std::vector<size_t>(1, id)) == 1; }
+
+        inline bool isPointActive(size_t id) const { return id < removed_.size() && !removed_[id]; }
+
+        // Number of active (inserted and not removed) points
+        inline size_t size() const { return num_active_; }
+
+        // Id that the next inserted point will get
+        inline size_t getNextPointId() const { return removed_.size(); }
+
+        inline size_t getNumberOfTrees() const { return trees_.size(); }
+
+        void nearestNeighborSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t &neighbor, ScalarT &distance, ScalarT eps = 0) const {
+            nanoflann::KNNResultSet<ScalarT,size_t> result_set(1);
+            result_set.init(&neighbor, &distance);
+            find_neighbors_(query_pt, result_set, eps);
+        }
+
+        void kNNSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t k, std::vector<size_t> &neighbors, std::vector<ScalarT> &distances, ScalarT eps = 0) const {
+            k = std::min(k, num_active_);
+            neighbors.resize(k);
+            distances.resize(k);
+            if (k == 0) return;
+            nanoflann::KNNResultSet<ScalarT,size_t> result_set(k);
+            result_set.init(neighbors.data(), distances.data());
+            find_neighbors_(query_pt, result_set, eps);
+        }
+
+        void radiusSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, ScalarT radius, std::vector<size_t> &neighbors, std::vector<ScalarT> &distances, ScalarT eps = 0) const {
+            std::vector<std::pair<size_t,ScalarT> > matches;
+            radius_search_(query_pt, radius, matches, neighbors, distances, eps);
+        }
+
+        void kNNInRadiusSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t k, ScalarT radius, std::vector<size_t> &neighbors, std::vector<ScalarT> &distances, ScalarT eps = 0) const {
+            neighbors.resize(k);
+            distances.resize(k);
+            if (k == 0) return;
+            KNNInRadiusResultSet<ScalarT,size_t> result_set(k, radius);
+            result_set.init(neighbors.data(), distances.data());
+            find_neighbors_(query_pt, result_set, eps);
+            neighbors.resize(result_set.size());
+            distances.resize(result_set.size());
+        }
+
+        // Searches that write into a reusable context
+        inline void kNNSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t k, SearchContext<ScalarT> &context, ScalarT eps = 0) const {
+            kNNSearch(query_pt, k, context.neighbors, context.distances, eps);
+        }
+
+        inline void radiusSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, ScalarT radius, SearchContext<ScalarT> &context, ScalarT eps = 0) const {
+            radius_search_(query_pt, radius, context.matches, context.neighbors, context.distances, eps);
+        }
+
+        inline void kNNInRadiusSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t k, ScalarT radius, SearchContext<ScalarT> &context, ScalarT eps = 0) const {
+            kNNInRadiusSearch(query_pt, k, radius, context.neighbors, context.distances, eps);
+        }
+
+    private:
+        // A static tree over its own copy of the points; ids maps tree-local indices to point ids
+        struct Tree_ {
+            Eigen::Matrix<ScalarT,EigenDim,Eigen::Dynamic> points;
+            std::vector<size_t> ids;
+            std::unique_ptr<KDTree<ScalarT,EigenDim,DistAdaptor> > tree;
+        };
+
+        // Forwards tree-local matches to the wrapped result set as point ids, skipping removed points
+        template <class ResultSetT>
+        struct IdResultSet_ {
+            inline IdResultSet_(ResultSetT &result_set, const std::vector<size_t> &ids, const std::vector<bool> &removed)
+                    : result_set(result_set), ids(ids), removed(removed)
+            {}
+
+            inline size_t size() const { return result_set.size(); }
+            inline bool full() const { return result_set.full(); }
+            inline ScalarT worstDist() const { return result_set.worstDist(); }
+            inline bool addPoint(ScalarT dist, size_t index) {
+                size_t id = ids[index];
+                if (removed[id]) return true;
+                return result_set.addPoint(dist, id);
+            }
+
+            ResultSetT &result_set;
+            const std::vector<size_t> &ids;
+            const std::vector<bool> &removed;
+        };
+
+        size_t max_leaf_size_;
+        size_t num_active_;
+        size_t num_stored_;
+        std::vector<bool> removed_;
+        std::vector<std::unique_ptr<Tree_> > trees_;
+
+        // Builds a tree over the new points (with ids starting at first_id) and the active points of the absorbed trees
+        Tree_ * build_tree_(const ConstDataMatrixMap<ScalarT,EigenDim> &points, size_t first_id, const std::vector<std::unique_ptr<Tree_> > &absorbed) {
+            size_t num_points = points.cols();
+            for (size_t t = 0; t < absorbed.size(); t++) {
+                num_stored_ -= absorbed[t]->ids.size();
+                for (size_t i = 0; i < absorbed[t]->ids.size(); i++) {
+                    if (!removed_[absorbed[t]->ids[i]]) num_points++;
+                }
+            }
+
+            Tree_ * res = new Tree_;
+            res->points.resize(EigenDim, num_points);
+            res->ids.resize(num_points);
+            size_t count = 0;
+            for (size_t i = 0; i < (size_t)points.cols(); i++) {
+                res->points.col(count) = points.col(i);
+                res->ids[count++] = first_id + i;
+            }
+            for (size_t t = 0; t < absorbed.size(); t++) {
+                for (size_t i = 0; i < absorbed[t]->ids.size(); i++) {
+                    if (removed_[absorbed[t]->ids[i]]) continue;
+                    res->points.col(count) = absorbed[t]->points.col(i);
+                    res->ids[count++] = absorbed[t]->ids[i];
+                }
+            }
+            res->tree.reset(new KDTree<ScalarT,EigenDim,DistAdaptor>(res->points, max_leaf_size_));
+            num_stored_ += num_points;
+            return res;
+        }
+
+        template <class ResultSetT>
+        inline void find_neighbors_(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, ResultSetT &result_set, ScalarT eps) const {
+            for (size_t i = 0; i < trees_.size(); i++) {
+                IdResultSet_<ResultSetT> id_result_set(result_set, trees_[i]->ids, removed_);
+                trees_[i]->tree->findNeighbors(query_pt, id_result_set, eps);
+            }
+        }
+
+        // Result buffers are cleared but never shrunk, so their capacity is reused across calls
+        inline void radius_search_(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, ScalarT radius, std::vector<std::pair<size_t,ScalarT> > &matches, std::vector<size_t> &neighbors, std::vector<ScalarT> &distances, ScalarT eps) const {
+            nanoflann::RadiusResultSet<ScalarT,size_t> result_set(radius, matches);
+            find_neighbors_(query_pt, result_set, eps);
+            std::sort(matches.begin(), matches.end(), nanoflann::IndexDist_Sorter());
+            size_t num_results = matches.size();
+            neighbors.resize(num_results);
+            distances.resize(num_results);
+            for (size_t i = 0; i < num_results; i++) {
+                neighbors[i] = matches[i].first;
+                distances[i] = matches[i].second;
+            }
+        }
+    };
+
+    typedef DynamicKDTree<float,2,KDTreeDistanceAdaptors::L2> DynamicKDTree2D;
+    typedef DynamicKDTree<float,3,KDTreeDistanceAdaptors::L2> DynamicKDTree3D;
+}
@@ -0,0 +1,384 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <cilantro/neighborhood_search.hpp>
+
+namespace cilantro {
+    // Fixed-radius neighbor index: a uniform grid whose occupied cells are looked up in a hash table. With the
+    // cell size set to the query radius, a query scans at most 3^EigenDim cells and building is O(1) per
+    // point, which beats tree traversal for one-radius queries over data of fairly uniform density.
+    // Distances are squared Euclidean and, as for KDTree with the L2 adaptors, search radii are squared
+    // distances (the cell size is not). kNN searches expand ring by ring around the query cell. Approximate
+    // search is not supported (eps is ignored).
+    template <typename ScalarT, ptrdiff_t EigenDim>
+    class HashGrid : public NeighborhoodSearchBase<HashGrid<ScalarT,EigenDim>,ScalarT,EigenDim> {
+    public:
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        typedef NeighborhoodSearchBase<HashGrid<ScalarT,EigenDim>,ScalarT,EigenDim> Base;
+        typedef typename Base::NeighborhoodType NeighborhoodType;
+        typedef typename Base::Neighborhood Neighborhood;
+
+        using Base::search;
+        using Base::kNNSearch;
+        using Base::radiusSearch;
+        using Base::kNNInRadiusSearch;
+
+        HashGrid(const ConstDataMatrixMap<ScalarT,EigenDim> &data, ScalarT cell_size)
+                : data_map_(data),
+                  cell_size_(cell_size)
+        {
+            build_index_();
+        }
+
+        ~HashGrid() {}
+
+        inline const ConstDataMatrixMap<ScalarT,EigenDim>& getPointsMatrixMap() const { return data_map_; }
+
+        inline ScalarT getCellSize() const { return cell_size_; }
+
+        inline size_t getNumberOfCells() const { return cell_offsets_.size() - 1; }
+
+        void nearestNeighborSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t &neighbor, ScalarT &distance, ScalarT /*eps*/ = 0) const {
+            KNNInRadiusResultSet<ScalarT,size_t> result_set(1, std::numeric_limits<ScalarT>::max());
+            result_set.init(&neighbor, &distance);
+            knn_search_(query_pt, result_set);
+        }
+
+        void kNNSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t k, std::vector<size_t> &neighbors, std::vector<ScalarT> &distances, ScalarT /*eps*/ = 0) const {
+            k = std::min(k, (size_t)data_map_.cols());
+            neighbors.resize(k);
+            distances.resize(k);
+            if (k == 0) return;
+            KNNInRadiusResultSet<ScalarT,size_t> result_set(k, std::numeric_limits<ScalarT>::max());
+            result_set.init(neighbors.data(), distances.data());
+            knn_search_(query_pt, result_set);
+        }
+
+        void radiusSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, ScalarT radius, std::vector<size_t> &neighbors, std::vector<ScalarT> &distances, ScalarT /*eps*/ = 0) const {
+            std::vector<std::pair<size_t,ScalarT> > matches;
+            radius_search_(query_pt, radius, matches, neighbors, distances);
+        }
+
+        void kNNInRadiusSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t k, ScalarT radius, std::vector<size_t> &neighbors, std::vector<ScalarT> &distances, ScalarT /*eps*/ = 0) const {
+            neighbors.resize(k);
+            distances.resize(k);
+            if (k == 0) return;
+            KNNInRadiusResultSet<ScalarT,size_t> result_set(k, radius);
+            result_set.init(neighbors.data(), distances.data());
+            ball_search_(query_pt, radius, result_set);
+            neighbors.resize(result_set.size());
+            distances.resize(result_set.size());
+        }
+
+        // Searches that write into a reusable context
+        inline void kNNSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t k, SearchContext<ScalarT> &context, ScalarT eps = 0) const {
+            kNNSearch(query_pt, k, context.neighbors, context.distances, eps);
+        }
+
+        inline void radiusSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, ScalarT radius, SearchContext<ScalarT> &context, ScalarT /*eps*/ = 0) const {
+            radius_search_(query_pt, radius, context.matches, context.neighbors, context.distances);
+        }
+
+        inline void kNNInRadiusSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t k, ScalarT radius, SearchContext<ScalarT> &context, ScalarT eps = 0) const {
+            kNNInRadiusSearch(query_pt, k, radius, context.neighbors, context.distances, eps);
+        }
+
+    private:
+        typedef std::array<ptrdiff_t,EigenDim> Cell_;
+
+        static const size_t EMPTY_SLOT_ = std::numeric_limits<size_t>::max();
+
+        // Collects all points within radius
+        struct RadiusResultSet_ {
+            inline RadiusResultSet_(ScalarT radius, std::vector<std::pair<size_t,ScalarT> > &matches) : radius(radius), matches(matches) {}
+
+            inline ScalarT worstDist() const { return radius; }
+            inline bool addPoint(ScalarT dist, size_t index) {
+                matches.emplace_back(index, dist);
+                return true;
+            }
+
+            ScalarT radius;
+            std::vector<std::pair<size_t,ScalarT> > &matches;
+        };
+
+        ConstDataMatrixMap<ScalarT,EigenDim> data_map_;
+        ScalarT cell_size_;
+
+        // Points sorted by cell: cell c holds points [cell_offsets_[c], cell_offsets_[c+1]) of points_, whose
+        // original indices are in point_indices_
+        std::vector<size_t> cell_offsets_;
+        std::vector<size_t> point_indices_;
+        Eigen::Matrix<ScalarT,EigenDim,Eigen::Dynamic> points_;
+
+        // Open addressing hash table (linear probing, at most half full) from cell coordinates to cell numbers
+        std::vector<std::pair<Cell_,size_t> > cell_table_;
+        size_t cell_table_mask_;
+
+        // Bounds of the occupied cells
+        Cell_ min_cell_;
+        Cell_ max_cell_;
+
+        inline ptrdiff_t get_cell_coordinate_(ScalarT val) const { return (ptrdiff_t)std::floor(val/cell_size_); }
+
+        static inline size_t hash_cell_(const Cell_ &cell) {
+            uint64_t hash = 0;
+            for (size_t d = 0; d < EigenDim; d++) {
+                hash = (hash ^ (uint64_t)cell[d])*0x9E3779B97F4A7C15ULL;
+            }
+            return (size_t)(hash ^ (hash >> 32));
+        }
+
+        // Slot of the cell, or of the empty slot where it would be inserted
+        inline size_t find_slot_(const Cell_ &cell) const {
+            size_t slot = hash_cell_(cell) & cell_table_mask_;
+            while (cell_table_[slot].second != EMPTY_SLOT_ && cell_table_[slot].first != cell) {
+                slot = (slot + 1) & cell_table_mask_;
+            }
+            return slot;
+        }
+
+        // Cell coordinate range [min_cell_[dim], max_cell_[dim]] clamped to the cells that overlap [low, high]
+        inline void get_cell_range_(ScalarT low, ScalarT high, size_t dim, ptrdiff_t &first, ptrdiff_t &last) const {
+            ScalarT first_val = std::floor(low/cell_size_);
+            ScalarT last_val = std::floor(high/cell_size_);
+            first = (first_val > (ScalarT)min_cell_[dim]) ? (ptrdiff_t)first_val : min_cell_[dim];
+            last = (last_val < (ScalarT)max_cell_[dim]) ? (ptrdiff_t)last_val : max_cell_[dim];
+        }
+
+        void build_index_() {
+            size_t num_points = data_map_.cols();
+            cell_offsets_.assign(1, 0);
+            point_indices_.resize(num_points);
+            points_.resize(EigenDim, num_points);
+            cell_table_mask_ = 1;
+            cell_table_.assign(2, std::pair<Cell_,size_t>(Cell_(), EMPTY_SLOT_));
+            if (num_points == 0) return;
+
+            std::vector<Cell_> point_cells(num_points);
+#pragma omp parallel for
+            for (size_t i = 0; i < num_points; i++) {
+                for (size_t d = 0; d < EigenDim; d++) {
+                    point_cells[i][d] = get_cell_coordinate_(data_map_(d,i));
+                }
+            }
+
+            // Collect the occupied cells
+            std::vector<Cell_> cells;
+            std::vector<size_t> point_cell_ids(num_points);
+            for (size_t i = 0; i < num_points; i++) {
+                size_t slot = find_slot_(point_cells[i]);
+                if (cell_table_[slot].second == EMPTY_SLOT_) {
+                    cell_table_[slot] = std::pair<Cell_,size_t>(point_cells[i], cells.size());
+                    cells.emplace_back(point_cells[i]);
+                    if (2*cells.size() > cell_table_.size()) {
+                        grow_cell_table_();
+                        slot = find_slot_(point_cells[i]);
+                    }
+                }
+                point_cell_ids[i] = cell_table_[slot].second;
+            }
+
+            // Renumber cells in lexicographic order, with the first coordinate varying fastest, so that the
+            // occupied cells of any run along the first axis are stored contiguously
+            size_t num_cells = cells.size();
+            std::vector<size_t> cell_order(num_cells);
+            for (size_t c = 0; c < num_cells; c++) cell_order[c] = c;
+            std::sort(cell_order.begin(), cell_order.end(), [&cells](size_t a, size_t b) {
+                for (size_t d = EigenDim; d > 0; d--) {
+                    if (cells[a][d-1] != cells[b][d-1]) return cells[a][d-1] < cells[b][d-1];
+                }
+                return false;
+            });
+            std::vector<size_t> cell_rank(num_cells);
+            for (size_t c = 0; c < num_cells; c++) cell_rank[cell_order[c]] = c;
+            for (size_t s = 0; s < cell_table_.size(); s++) {
+                if (cell_table_[s].second != EMPTY_SLOT_) cell_table_[s].second = cell_rank[cell_table_[s].second];
+            }
+
+            min_cell_ = max_cell_ = cells[0];
+            for (size_t c = 1; c < num_cells; c++) {
+                for (size_t d = 0; d < EigenDim; d++) {
+                    min_cell_[d] = std::min(min_cell_[d], cells[c][d]);
+                    max_cell_[d] = std::max(max_cell_[d], cells[c][d]);
+                }
+            }
+
+            // Counting sort of the points by cell
+            cell_offsets_.assign(num_cells + 1, 0);
+            for (size_t i = 0; i < num_points; i++) {
+                point_cell_ids[i] = cell_rank[point_cell_ids[i]];
+                cell_offsets_[point_cell_ids[i] + 1]++;
+            }
+            for (size_t c = 0; c < num_cells; c++) {
+                cell_offsets_[c+1] += cell_offsets_[c];
+            }
+            std::vector<size_t> cell_pos(cell_offsets_.begin(), cell_offsets_.end() - 1);
+            for (size_t i = 0; i < num_points; i++) {
+                point_indices_[cell_pos[point_cell_ids[i]]++] = i;
+            }
+
+#pragma omp parallel for
+            for (size_t i = 0; i < num_points; i++) {
+                points_.col(i) = data_map_.col(point_indices_[i]);
+            }
+        }
+
+        void grow_cell_table_() {
+            std::vector<std::pair<Cell_,size_t> > old_table(2*cell_table_.size(), std::pair<Cell_,size_t>(Cell_(), EMPTY_SLOT_));
+            old_table.swap(cell_table_);
+            cell_table_mask_ = cell_table_.size() - 1;
+            for (size_t i = 0; i < old_table.size(); i++) {
+                if (old_table[i].second != EMPTY_SLOT_) cell_table_[find_slot_(old_table[i].first)] = old_table[i];
+            }
+        }
+
+        inline size_t find_cell_(const Cell_ &cell) const { return cell_table_[find_slot_(cell)].second; }
+
+        template <class ResultSetT>
+        inline void scan_points_(size_t begin, size_t end, const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, ResultSetT &result_set) const {
+            for (size_t i = begin; i < end; i++) {
+                ScalarT dist = (points_.col(i) - query_pt).squaredNorm();
+                if (dist < result_set.worstDist()) result_set.addPoint(dist, point_indices_[i]);
+            }
+        }
+
+        // Squared distance from val to the extent of cell coordinate c
+        inline ScalarT get_cell_distance_(ScalarT val, ptrdiff_t c) const {
+            ScalarT low = c*cell_size_;
+            if (val < low) return (low - val)*(low - val);
+            ScalarT high = low + cell_size_;
+            if (val > high) return (val - high)*(val - high);
+            return 0;
+        }
+
+        // Scans the cells that intersect the search ball, one run along the first axis at a time: the run is
+        // trimmed to the ball, and the points of its occupied cells form a single contiguous range
+        template <class ResultSetT>
+        void ball_search_(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, ScalarT radius, ResultSetT &result_set) const {
+            if (data_map_.cols() == 0) return;
+            ScalarT r = std::sqrt(radius);
+            Cell_ first, last, cell;
+            for (size_t d = 0; d < EigenDim; d++) {
+                get_cell_range_(query_pt[d] - r, query_pt[d] + r, d, first[d], last[d]);
+                if (first[d] > last[d]) return;
+            }
+            cell = first;
+            while (true) {
+                ScalarT run_dist = 0;
+                for (size_t d = 1; d < EigenDim; d++) {
+                    run_dist += get_cell_distance_(query_pt[d], cell[d]);
+                }
+                if (run_dist < radius) {
+                    ScalarT run_r = std::sqrt(radius - run_dist);
+                    ptrdiff_t run_first, run_last;
+                    get_cell_range_(query_pt[0] - run_r, query_pt[0] + run_r, 0, run_first, run_last);
+                    size_t begin_cell = EMPTY_SLOT_, end_cell = EMPTY_SLOT_;
+                    for (cell[0] = run_first; cell[0] <= run_last && begin_cell == EMPTY_SLOT_; cell[0]++) {
+                        begin_cell = find_cell_(cell);
+                    }
+                    for (cell[0] = run_last; cell[0] >= run_first && end_cell == EMPTY_SLOT_; cell[0]--) {
+                        end_cell = find_cell_(cell);
+                    }
+                    if (begin_cell != EMPTY_SLOT_) scan_points_(cell_offsets_[begin_cell], cell_offsets_[end_cell + 1], query_pt, result_set);
+                }
+
+                size_t d = 1;
+                while (d < EigenDim && cell[d] == last[d]) {
+                    cell[d] = first[d];
+                    d++;
+                }
+                if (d >= EigenDim) break;
+                cell[d]++;
+            }
+        }
+
+        // Scans the points of the occupied cells of the box [first, last]
+        template <class ResultSetT>
+        inline void scan_cells_(const Cell_ &first, const Cell_ &last, const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, ResultSetT &result_set) const {
+            Cell_ cell(first);
+            while (true) {
+                size_t cell_id = find_cell_(cell);
+                if (cell_id != EMPTY_SLOT_) scan_points_(cell_offsets_[cell_id], cell_offsets_[cell_id + 1], query_pt, result_set);
+                size_t d = 0;
+                while (d < EigenDim && cell[d] == last[d]) {
+                    cell[d] = first[d];
+                    d++;
+                }
+                if (d == EigenDim) break;
+                cell[d]++;
+            }
+        }
+
+        // Visits cells in rings of growing Chebyshev distance from the query cell, until no unvisited cell
+        // can hold a point closer than the current k-th neighbor
+        template <class ResultSetT>
+        void knn_search_(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, ResultSetT &result_set) const {
+            if (data_map_.cols() == 0) return;
+            Cell_ query_cell, first, last;
+            // Distance from the query to the closest face of its cell
+            ScalarT face_dist = cell_size_;
+            ptrdiff_t ring = 0, max_ring = 0;
+            for (size_t d = 0; d < EigenDim; d++) {
+                query_cell[d] = get_cell_coordinate_(query_pt[d]);
+                ScalarT low = query_pt[d] - query_cell[d]*cell_size_;
+                face_dist = std::min(face_dist, std::min(low, cell_size_ - low));
+                // Rings closer than the occupied bounds are empty
+                ring = std::max(ring, std::max(min_cell_[d] - query_cell[d], query_cell[d] - max_cell_[d]));
+                max_ring = std::max(max_ring, std::max(query_cell[d] - min_cell_[d], max_cell_[d] - query_cell[d]));
+            }
+            face_dist = std::max(face_dist, (ScalarT)0);
+
+            for (; ring <= max_ring; ring++) {
+                // The ring is split by the first axis along which a cell is at distance ring: the two faces
+                // at +-ring along axis a, restricted to the interior along the axes before a, so that only
+                // the ring's cells are visited, each once
+                const size_t num_face_axes = (ring > 0) ? EigenDim : 1;
+                for (size_t a = 0; a < num_face_axes; a++) {
+                    bool empty = false;
+                    for (size_t d = 0; d < EigenDim; d++) {
+                        if (d == a) continue;
+                        const ptrdiff_t inner = (d < a) ? 1 : 0;
+                        first[d] = std::max(query_cell[d] - ring + inner, min_cell_[d]);
+                        last[d] = std::min(query_cell[d] + ring - inner, max_cell_[d]);
+                        if (first[d] > last[d]) empty = true;
+                    }
+                    if (empty) continue;
+                    for (ptrdiff_t side = -ring; side <= ring; side += std::max<ptrdiff_t>(2*ring, 1)) {
+                        first[a] = last[a] = query_cell[a] + side;
+                        if (first[a] < min_cell_[a] || first[a] > max_cell_[a]) continue;
+                        scan_cells_(first, last, query_pt, result_set);
+                    }
+                }
+
+                ScalarT bound = ring*cell_size_ + face_dist;
+                if (bound*bound >= result_set.worstDist()) break;
+            }
+        }
+
+        // Result buffers are cleared but never shrunk, so their capacity is reused across calls
+        inline void radius_search_(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, ScalarT radius, std::vector<std::pair<size_t,ScalarT> > &matches, std::vector<size_t> &neighbors, std::vector<ScalarT> &distances) const {
+            matches.clear();
+            RadiusResultSet_ result_set(radius, matches);
+            ball_search_(query_pt, radius, result_set);
+            std::sort(matches.begin(), matches.end(), [](const std::pair<size_t,ScalarT> &a, const std::pair<size_t,ScalarT> &b) { return a.second < b.second; });
+            size_t num_results = matches.size();
+            neighbors.resize(num_results);
+            distances.resize(num_results);
+            for (size_t i = 0; i < num_results; i++) {
+                neighbors[i] = matches[i].first;
+                distances[i] = matches[i].second;
+            }
+        }
+    };
+
+    template <typename ScalarT, ptrdiff_t EigenDim>
+    const size_t HashGrid<ScalarT,EigenDim>::EMPTY_SLOT_;
+
+    typedef HashGrid<float,2> HashGrid2D;
+    typedef HashGrid<float,3> HashGrid3D;
+}
@@ -88,6 +88,14 @@ namespace cilantro {
             return *this;
         }
 
+        // Approximation factor of the correspondence search (0 for exact nearest neighbors)
+        inline float getCorrespondenceSearchEpsilon() const { return corr_search_eps_; }
+        inline IterativeClosestPoint& setCorrespondenceSearchEpsilon(float eps) {
+            iteration_count_ = 0;
+            corr_search_eps_ = eps;
+            return *this;
+        }
+
         inline float getCorrespondencesFraction() const { return corr_fraction_; }
         inline IterativeClosestPoint& setCorrespondencesFraction(float corr_fraction) {
             iteration_count_ = 0;
@@ -168,9 +176,11 @@ namespace cilantro {
         const std::vector<Eigen::Vector3f> *src_normals_;
         const std::vector<Eigen::Vector3f> *src_colors_;
 
-        KDTree<float,3,KDTreeDistanceAdaptors::L2> *kd_tree_3d_;
-        KDTree<float,6,KDTreeDistanceAdaptors::L2> *kd_tree_6d_;
-        KDTree<float,9,KDTreeDistanceAdaptors::L2> *kd_tree_9d_;
+        KDTree<float,3,KDTreeDistanceAdaptors::L2Vectorized> *kd_tree_3d_;
+        KDTree<float,6,KDTreeDistanceAdaptors::L2Vectorized> *kd_tree_6d_;
+        KDTree<float,9,KDTreeDistanceAdaptors::L2Vectorized> *kd_tree_9d_;
+        // Partition of the source points for dual-tree correspondence search (reused as the points move)
+        KDTree<float,3,KDTreeDistanceAdaptors::L2> *src_kd_tree_3d_;
 
         CorrespondencesType corr_type_;
         float point_dist_weight_;
@@ -183,6 +193,7 @@ namespace cilantro {
 
         float corr_dist_thres_;
         float corr_fraction_;
+        float corr_search_eps_;
         float convergence_tol_;
         size_t max_iter_;
         size_t max_estimation_iter_;
@@ -201,6 +212,11 @@ namespace cilantro {
         std::vector<Eigen::Matrix<float,6,1> > dst_data_points_6d_;
         std::vector<Eigen::Matrix<float,9,1> > dst_data_points_9d_;
 
+        std::vector<Eigen::Vector3f> src_queries_3d_;
+        std::vector<Eigen::Matrix<float,6,1> > src_queries_6d_;
+        std::vector<Eigen::Matrix<float,9,1> > src_queries_9d_;
+        NeighborhoodSet<float> nn_results_;
+
         std::vector<size_t> dst_ind_;
         std::vector<size_t> src_ind_;
         std::vector<size_t> dst_ind_all_;
@@ -0,0 +1,305 @@
+#pragma once
+
+#include <random>
+#include <cilantro/kd_tree.hpp>
+
+namespace cilantro {
+    // Randomized kd-forest for approximate nearest neighbor search in higher dimensions (e.g. feature
+    // descriptors), as in FLANN. Each tree splits at the mean of a dimension picked at random among the
+    // highest variance ones; a query descends all trees and then explores the closest unvisited branches of
+    // the whole forest from a single priority queue, until it has examined max_checks points (and has found
+    // k neighbors). Larger check budgets and more trees give more accurate results; with an unlimited budget
+    // the search is exact (for eps = 0). Distances and radii are in the units of DistAdaptor (squared
+    // distances for L2), and eps prunes branches as in KDTree.
+    template <typename ScalarT, ptrdiff_t EigenDim, template <class> class DistAdaptor>
+    class KDForest : public NeighborhoodSearchBase<KDForest<ScalarT,EigenDim,DistAdaptor>,ScalarT,EigenDim> {
+    public:
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        typedef NeighborhoodSearchBase<KDForest<ScalarT,EigenDim,DistAdaptor>,ScalarT,EigenDim> Base;
+        typedef typename Base::NeighborhoodType NeighborhoodType;
+        typedef typename Base::Neighborhood Neighborhood;
+
+        using Base::search;
+        using Base::kNNSearch;
+        using Base::radiusSearch;
+        using Base::kNNInRadiusSearch;
+
+        // Trees are built in parallel; seed makes the forest reproducible
+        KDForest(const ConstDataMatrixMap<ScalarT,EigenDim> &data, size_t num_trees = 4, size_t max_checks = 512, size_t max_leaf_size = 10, unsigned int seed = 0)
+                : data_map_(data),
+                  mat_to_kd_(data_map_),
+                  distance_(mat_to_kd_),
+                  trees_(std::max(num_trees, (size_t)1)),
+                  max_checks_(max_checks),
+                  max_leaf_size_(std::max(max_leaf_size, (size_t)1))
+        {
+            build_index_(seed);
+        }
+
+        ~KDForest() {}
+
+        inline const ConstDataMatrixMap<ScalarT,EigenDim>& getPointsMatrixMap() const { return data_map_; }
+
+        inline size_t getNumberOfTrees() const { return trees_.size(); }
+
+        inline size_t getMaxChecks() const { return max_checks_; }
+
+        inline KDForest& setMaxChecks(size_t max_checks) {
+            max_checks_ = max_checks;
+            return *this;
+        }
+
+        void nearestNeighborSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t &neighbor, ScalarT &distance, ScalarT eps = 0) const {
+            KNNInRadiusResultSet<ScalarT,size_t> result_set(1, std::numeric_limits<ScalarT>::max());
+            result_set.init(&neighbor, &distance);
+            find_neighbors_(query_pt.data(), result_set, &neighbor, eps);
+        }
+
+        void kNNSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t k, std::vector<size_t> &neighbors, std::vector<ScalarT> &distances, ScalarT eps = 0) const {
+            kNNInRadiusSearch(query_pt, k, std::numeric_limits<ScalarT>::max(), neighbors, distances, eps);
+        }
+
+        void radiusSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, ScalarT radius, std::vector<size_t> &neighbors, std::vector<ScalarT> &distances, ScalarT eps = 0) const {
+            std::vector<std::pair<size_t,ScalarT> > matches;
+            radius_search_(query_pt, radius, matches, neighbors, distances, eps);
+        }
+
+        void kNNInRadiusSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t k, ScalarT radius, std::vector<size_t> &neighbors, std::vector<ScalarT> &distances, ScalarT eps = 0) const {
+            k = std::min(k, (size_t)data_map_.cols());
+            neighbors.resize(k);
+            distances.resize(k);
+            if (k == 0) return;
+            KNNInRadiusResultSet<ScalarT,size_t> result_set(k, radius);
+            result_set.init(neighbors.data(), distances.data());
+            find_neighbors_(query_pt.data(), result_set, neighbors.data(), eps);
+            neighbors.resize(result_set.size());
+            distances.resize(result_set.size());
+        }
+
+        // Searches that write into a reusable context
+        inline void kNNSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t k, SearchContext<ScalarT> &context, ScalarT eps = 0) const {
+            kNNSearch(query_pt, k, context.neighbors, context.distances, eps);
+        }
+
+        inline void radiusSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, ScalarT radius, SearchContext<ScalarT> &context, ScalarT eps = 0) const {
+            radius_search_(query_pt, radius, context.matches, context.neighbors, context.distances, eps);
+        }
+
+        inline void kNNInRadiusSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t k, ScalarT radius, SearchContext<ScalarT> &context, ScalarT eps = 0) const {
+            kNNInRadiusSearch(query_pt, k, radius, context.neighbors, context.distances, eps);
+        }
+
+    private:
+        typedef KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim> DataAdaptor_;
+        typedef DistAdaptor<DataAdaptor_> Distance_;
+        typedef typename Distance_::DistanceType DistanceType_;
+
+        // Nodes are stored in depth-first order: internal nodes are followed by their first child (points
+        // below divval), leaves refer to a range of the tree's point permutation
+        struct Node_ {
+            size_t first;       // Second child for internal nodes, range begin for leaves
+            size_t last;        // Range end for leaves
+            int divfeat;        // -1 for leaves
+            ScalarT divval;
+        };
+
+        struct Tree_ {
+            std::vector<Node_> nodes;
+            std::vector<size_t> vind;
+        };
+
+        // Unexplored branch, with the lower bound estimate of its distance to the query
+        // offsets: start of the branch cell's per-dimension distances in the search's offset buffer
+        struct Branch_ {
+            DistanceType_ dist;
+            size_t tree;
+            size_t node;
+            size_t offsets;
+
+            inline bool operator<(const Branch_ &other) const { return dist > other.dist; }
+        };
+
+        ConstDataMatrixMap<ScalarT,EigenDim> data_map_;
+        const DataAdaptor_ mat_to_kd_;
+        Distance_ distance_;
+        std::vector<Tree_> trees_;
+        size_t max_checks_;
+        size_t max_leaf_size_;
+
+        void build_index_(unsigned int seed) {
+            size_t num_points = data_map_.cols();
+#pragma omp parallel for schedule(dynamic)
+            for (size_t t = 0; t < trees_.size(); t++) {
+                Tree_ &tree(trees_[t]);
+                std::mt19937 rng(seed + (unsigned int)t);
+                tree.vind.resize(num_points);
+                for (size_t i = 0; i < num_points; i++) tree.vind[i] = i;
+                // Shuffled, so that the split statistics below are taken from a random sample of each node
+                std::shuffle(tree.vind.begin(), tree.vind.end(), rng);
+                tree.nodes.clear();
+                if (num_points > 0) divide_tree_(tree, 0, num_points, rng);
+            }
+        }
+
+        void divide_tree_(Tree_ &tree, size_t left, size_t right, std::mt19937 &rng) {
+            size_t ind = tree.nodes.size();
+            tree.nodes.emplace_back();
+            if (right - left <= max_leaf_size_) {
+                Node_ leaf = {left, right, -1, 0};
+                tree.nodes[ind] = leaf;
+                return;
+            }
+
+            int divfeat;
+            ScalarT divval;
+            choose_split_(tree, left, right, rng, divfeat, divval);
+            size_t split = left + plane_split_(&tree.vind[left], right - left, divfeat, divval);
+
+            divide_tree_(tree, left, split, rng);
+            Node_ node = {tree.nodes.size(), 0, divfeat, divval};
+            tree.nodes[ind] = node;
+            divide_tree_(tree, split, right, rng);
+        }
+
+        // Mean and variance from (up to) the first 100 points of the node, split dimension picked at random
+        // among the (up to) 5 of highest variance
+        void choose_split_(const Tree_ &tree, size_t left, size_t right, std::mt19937 &rng, int &divfeat, ScalarT &divval) const {
+            const size_t max_samples = 100;
+            const size_t max_candidates = 5;
+            size_t dim = data_map_.rows();
+            size_t num_samples = std::min(right - left, max_samples);
+
+            Eigen::Matrix<ScalarT,EigenDim,1> mean(Eigen::Matrix<ScalarT,EigenDim,1>::Zero(dim));
+            Eigen::Matrix<ScalarT,EigenDim,1> var(Eigen::Matrix<ScalarT,EigenDim,1>::Zero(dim));
+            for (size_t i = 0; i < num_samples; i++) {
+                mean += data_map_.col(tree.vind[left + i]);
+            }
+            mean /= (ScalarT)num_samples;
+            for (size_t i = 0; i < num_samples; i++) {
+                var += (data_map_.col(tree.vind[left + i]) - mean).array().square().matrix();
+            }
+
+            std::vector<size_t> dims(dim);
+            for (size_t d = 0; d < dim; d++) dims[d] = d;
+            size_t num_candidates = std::min(dim, max_candidates);
+            std::partial_sort(dims.begin(), dims.begin() + num_candidates, dims.end(), [&var](size_t a, size_t b) { return var[a] > var[b]; });
+
+            divfeat = (int)dims[std::uniform_int_distribution<size_t>(0, num_candidates - 1)(rng)];
+            divval = mean[divfeat];
+        }
+
+        // Partitions ind[0..count) into points below, equal to and above divval along divfeat, and returns a
+        // split position that keeps both sides non-empty (balanced among equal values)
+        size_t plane_split_(size_t * ind, size_t count, int divfeat, ScalarT divval) const {
+            size_t left = 0;
+            size_t right = count - 1;
+            for (;;) {
+                while (left <= right && data_map_(divfeat,ind[left]) < divval) left++;
+                while (right && left <= right && data_map_(divfeat,ind[right]) >= divval) right--;
+                if (left > right || !right) break;
+                std::swap(ind[left], ind[right]);
+                left++;
+                right--;
+            }
+            size_t lim1 = left;
+            right = count - 1;
+            for (;;) {
+                while (left <= right && data_map_(divfeat,ind[left]) <= divval) left++;
+                while (right && left <= right && data_map_(divfeat,ind[right]) > divval) right--;
+                if (left > right || !right) break;
+                std::swap(ind[left], ind[right]);
+                left++;
+                right--;
+            }
+            size_t lim2 = left;
+
+            size_t split;
+            if (lim1 > count/2) split = lim1;
+            else if (lim2 < count/2) split = lim2;
+            else split = count/2;
+            if (split == 0 || split == count) split = count/2;
+            return split;
+        }
+
+        // Each point is stored in every tree, so a point may be reached more than once; neighbors (the result
+        // set's index array) is checked before inserting, which is only needed for points that would be kept
+        template <class ResultSetT>
+        void find_neighbors_(const ScalarT * query_pt, ResultSetT &result_set, const size_t * neighbors, ScalarT eps) const {
+            if (data_map_.cols() == 0) return;
+            DistanceType_ eps_error = 1 + eps;
+            size_t dim = data_map_.rows();
+            size_t checks = 0;
+            std::vector<Branch_> heap;
+            heap.reserve(64);
+            std::vector<DistanceType_> offsets;
+            std::vector<DistanceType_> dists(dim);
+            for (size_t t = 0; t < trees_.size(); t++) {
+                std::fill(dists.begin(), dists.end(), (DistanceType_)0);
+                search_level_(result_set, neighbors, query_pt, t, 0, 0, dists.data(), checks, heap, offsets, eps_error);
+            }
+            while (!heap.empty() && (checks < max_checks_ || !result_set.full())) {
+                std::pop_heap(heap.begin(), heap.end());
+                Branch_ branch(heap.back());
+                heap.pop_back();
+                if (branch.dist*eps_error >= result_set.worstDist()) break;
+                std::copy(offsets.begin() + branch.offsets, offsets.begin() + branch.offsets + dim, dists.begin());
+                search_level_(result_set, neighbors, query_pt, branch.tree, branch.node, branch.dist, dists.data(), checks, heap, offsets, eps_error);
+            }
+        }
+
+        // Descends to the closest leaf, queueing the other branches along the way. dists holds the distance
+        // from the query to the current cell along each dimension (as in nanoflann); crossing a splitting plane
+        // replaces the term of its dimension instead of adding to it, so mindist stays a lower bound and an
+        // unlimited check budget gives exact results. Queued branches keep a copy of their cell's distances.
+        template <class ResultSetT>
+        void search_level_(ResultSetT &result_set, const size_t * neighbors, const ScalarT * query_pt, size_t tree_ind, size_t node_ind, DistanceType_ mindist, const DistanceType_ * dists, size_t &checks, std::vector<Branch_> &heap, std::vector<DistanceType_> &offsets, DistanceType_ eps_error) const {
+            const Tree_ &tree(trees_[tree_ind]);
+            size_t dim = data_map_.rows();
+            while (tree.nodes[node_ind].divfeat >= 0) {
+                const Node_ &node(tree.nodes[node_ind]);
+                ScalarT val = query_pt[node.divfeat];
+                size_t best_child = (val < node.divval) ? node_ind + 1 : node.first;
+                size_t other_child = (val < node.divval) ? node.first : node_ind + 1;
+                DistanceType_ cut_dist = distance_.accum_dist(val, node.divval, node.divfeat);
+                DistanceType_ other_dist = mindist + cut_dist - dists[node.divfeat];
+                if (other_dist*eps_error < result_set.worstDist() || !result_set.full()) {
+                    Branch_ branch = {other_dist, tree_ind, other_child, offsets.size()};
+                    offsets.insert(offsets.end(), dists, dists + dim);
+                    offsets[branch.offsets + node.divfeat] = cut_dist;
+                    heap.emplace_back(branch);
+                    std::push_heap(heap.begin(), heap.end());
+                }
+                node_ind = best_child;
+            }
+
+            const Node_ &leaf(tree.nodes[node_ind]);
+            if (checks >= max_checks_ && result_set.full()) return;
+            for (size_t i = leaf.first; i < leaf.last; i++) {
+                size_t index = tree.vind[i];
+                DistanceType_ dist = distance_.evalMetric(query_pt, index, dim);
+                checks++;
+                if (dist >= result_set.worstDist()) continue;
+                if (neighbors != NULL && std::find(neighbors, neighbors + result_set.size(), index) != neighbors + result_set.size()) continue;
+                result_set.addPoint(dist, index);
+            }
+        }
+
+        // Result buffers are cleared but never shrunk, so their capacity is reused across calls; duplicates
+        // from different trees are removed after the search
+        inline void radius_search_(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, ScalarT radius, std::vector<std::pair<size_t,ScalarT> > &matches, std::vector<size_t> &neighbors, std::vector<ScalarT> &distances, ScalarT eps) const {
+            nanoflann::RadiusResultSet<ScalarT,size_t> result_set(radius, matches);
+            find_neighbors_(query_pt.data(), result_set, NULL, eps);
+            std::sort(matches.begin(), matches.end());
+            matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+            std::sort(matches.begin(), matches.end(), nanoflann::IndexDist_Sorter());
+            size_t num_results = matches.size();
+            neighbors.resize(num_results);
+            distances.resize(num_results);
+            for (size_t i = 0; i < num_results; i++) {
+                neighbors[i] = matches[i].first;
+                distances[i] = matches[i].second;
+            }
+        }
+    };
+}
@@ -1,7 +1,17 @@
 #pragma once
 
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <limits>
+#include <memory>
 #include <cilantro/3rd_party/nanoflann/nanoflann.hpp>
-#include <cilantro/data_matrix_map.hpp>
+#include <cilantro/neighborhood_search.hpp>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace cilantro {
     struct KDTreeDataAdaptors {
@@ -13,14 +23,24 @@ namespace cilantro {
             // A const ref to the data set origin
             const Eigen::Map<const Eigen::Matrix<ScalarT,EigenDim,Eigen::Dynamic> >& obj;
 
+            // Optional subset of the columns of obj to be indexed (NULL for all of them). It only seeds the
+            // tree's point permutation, which then holds column indices into obj, so points are accessed by
+            // their original index either way.
+            const size_t * indices;
+            size_t numPoints;
+
             /// The constructor that sets the data set source
-            EigenMap(const Eigen::Map<const Eigen::Matrix<ScalarT,EigenDim,Eigen::Dynamic> > &obj_) : obj(obj_) {}
+            EigenMap(const Eigen::Map<const Eigen::Matrix<ScalarT,EigenDim,Eigen::Dynamic> > &obj_) : obj(obj_), indices(NULL), numPoints(obj_.cols()) {}
+
+            EigenMap(const Eigen::Map<const Eigen::Matrix<ScalarT,EigenDim,Eigen::Dynamic> > &obj_, const size_t * indices_, size_t num_indices)
+                    : obj(obj_), indices(indices_), numPoints(num_indices)
+            {}
 
             /// CRTP helper method
             inline const Eigen::Map<const Eigen::Matrix<ScalarT,EigenDim,Eigen::Dynamic> >& derived() const { return obj; }
 
             // Must return the number of data points
-            inline size_t kdtree_get_point_count() const { return obj.cols(); }
+            inline size_t kdtree_get_point_count() const { return numPoints; }
 
             // Returns the dim'th component of the idx'th point in the class:
             // Since this is inlined and the "dim" argument is typically an immediate value, the
@@ -50,93 +70,1029 @@ namespace cilantro {
 
         template <class DataAdaptor>
         using SO3 = nanoflann::SO3_Adaptor<typename DataAdaptor::coord_t, DataAdaptor, typename DataAdaptor::coord_t>;
+
+        // Squared Euclidean distance, evaluated for blocks of leaf points at a time: the KDTree keeps a copy
+        // of the points in leaf order, with one contiguous array per dimension, and scans each leaf with
+        // evalLeafBlock(). Same metric as L2, at the cost of one extra copy of the data.
+        template <class DataAdaptor>
+        struct L2Vectorized : public nanoflann::L2_Adaptor<typename DataAdaptor::coord_t, DataAdaptor, typename DataAdaptor::coord_t> {
+            typedef typename DataAdaptor::coord_t ScalarT;
+
+            enum { LeafBlockSize = 8 };
+
+            L2Vectorized(const DataAdaptor &data_source) : nanoflann::L2_Adaptor<ScalarT, DataAdaptor, ScalarT>(data_source) {}
+
+            // Distances from query to the LeafBlockSize leaf-ordered points starting at row begin
+            template <class LeafPointsT>
+            static inline void evalLeafBlock(const ScalarT * query, const LeafPointsT &leaf_points, size_t begin, ScalarT * dists) {
+                Eigen::Map<Eigen::Array<ScalarT,LeafBlockSize,1> > res(dists);
+                res = (leaf_points.col(0).template segment<LeafBlockSize>(begin).array() - query[0]).square();
+                for (ptrdiff_t d = 1; d < leaf_points.cols(); d++) {
+                    res += (leaf_points.col(d).template segment<LeafBlockSize>(begin).array() - query[d]).square();
+                }
+            }
+        };
+    };
+
+    // Tells KDTree whether a distance adaptor scans leaves in blocks (see L2Vectorized)
+    template <class DistanceAdaptorT>
+    struct KDTreeLeafBlockTraits {
+        enum { Enabled = 0, BlockSize = 1 };
+
+        template <typename ScalarT, class LeafPointsT>
+        static inline void evalLeafBlock(const ScalarT *, const LeafPointsT &, size_t, ScalarT *) {}
+    };
+
+    template <class DataAdaptor>
+    struct KDTreeLeafBlockTraits<KDTreeDistanceAdaptors::L2Vectorized<DataAdaptor> > {
+        enum { Enabled = 1, BlockSize = KDTreeDistanceAdaptors::L2Vectorized<DataAdaptor>::LeafBlockSize };
+
+        template <typename ScalarT, class LeafPointsT>
+        static inline void evalLeafBlock(const ScalarT * query, const LeafPointsT &leaf_points, size_t begin, ScalarT * dists) {
+            KDTreeDistanceAdaptors::L2Vectorized<DataAdaptor>::evalLeafBlock(query, leaf_points, begin, dists);
+        }
     };
 
     template <typename ScalarT, ptrdiff_t EigenDim, template <class> class DistAdaptor>
-    class KDTree {
+    class KDTree : public NeighborhoodSearchBase<KDTree<ScalarT,EigenDim,DistAdaptor>,ScalarT,EigenDim> {
     public:
         EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
-        enum struct NeighborhoodType {KNN, RADIUS, KNN_IN_RADIUS};
-        struct Neighborhood {
-            inline Neighborhood() : type(NeighborhoodType::KNN), maxNumberOfNeighbors(1) {}
-            inline Neighborhood(size_t knn, ScalarT radius) : type(NeighborhoodType::KNN_IN_RADIUS), maxNumberOfNeighbors(knn), radius(radius) {}
-            inline Neighborhood(NeighborhoodType type, size_t knn, ScalarT radius) : type(type), maxNumberOfNeighbors(knn), radius(radius) {}
+        typedef NeighborhoodSearchBase<KDTree<ScalarT,EigenDim,DistAdaptor>,ScalarT,EigenDim> Base;
+        typedef typename Base::NeighborhoodType NeighborhoodType;
+        typedef typename Base::Neighborhood Neighborhood;
 
-            NeighborhoodType type;
-            size_t maxNumberOfNeighbors;
-            ScalarT radius;
-        };
+        using Base::search;
+        using Base::radiusSearch;
+        using Base::kNNInRadiusSearch;
+
+        // With flat_layout, the tree is also stored as a contiguous node array in depth-first order, with the
+        // points copied in leaf order, and searches traverse that copy instead of the pointer-based nodes
+        // (at the cost of one extra copy of the data)
+        KDTree(const ConstDataMatrixMap<ScalarT,EigenDim> &data, size_t max_leaf_size = 10, bool flat_layout = false)
+                : data_map_(data),
+                  mat_to_kd_(data_map_),
+                  kd_tree_(EigenDim, mat_to_kd_, nanoflann::KDTreeSingleIndexAdaptorParams(max_leaf_size)),
+                  flat_layout_(flat_layout),
+                  subset_(false)
+        {
+            params_.sorted = true;
+            build_index_();
+            update_search_data_();
+        }
+
+        // Tree over the columns of data listed in indices (distinct, and only needed during construction),
+        // without gathering them: searches return indices into data
+        KDTree(const ConstDataMatrixMap<ScalarT,EigenDim> &data, const std::vector<size_t> &indices, size_t max_leaf_size = 10, bool flat_layout = false)
+                : data_map_(data),
+                  mat_to_kd_(data_map_, indices.data(), indices.size()),
+                  kd_tree_(EigenDim, mat_to_kd_, nanoflann::KDTreeSingleIndexAdaptorParams(max_leaf_size)),
+                  flat_layout_(flat_layout),
+                  subset_(true)
+        {
+            params_.sorted = true;
+            build_index_();
+            update_search_data_();
+        }
 
-        KDTree(const ConstDataMatrixMap<ScalarT,EigenDim> &data, size_t max_leaf_size = 10)
+        // Loads a previously saved index for the same data; falls back to building it if loading fails
+        KDTree(const ConstDataMatrixMap<ScalarT,EigenDim> &data, const std::string &index_file_name, size_t max_leaf_size = 10, bool flat_layout = false)
                 : data_map_(data),
                   mat_to_kd_(data_map_),
-                  kd_tree_(EigenDim, mat_to_kd_, nanoflann::KDTreeSingleIndexAdaptorParams(max_leaf_size))
+                  kd_tree_(EigenDim, mat_to_kd_, nanoflann::KDTreeSingleIndexAdaptorParams(max_leaf_size)),
+                  flat_layout_(flat_layout),
+                  subset_(false)
         {
             params_.sorted = true;
-            kd_tree_.buildIndex();
+            if (!loadIndex(index_file_name)) {
+                build_index_();
+                update_search_data_();
+            }
         }
 
         ~KDTree() {}
 
-        void nearestNeighborSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t &neighbor, ScalarT &distance) const {
-            kd_tree_.knnSearch(query_pt.data(), 1, &neighbor, &distance);
+        // Writes the tree structure (not the points) to a versioned binary file
+        bool saveIndex(const std::string &file_name) const {
+            std::vector<IndexFileNode_> nodes;
+            if (kd_tree_.root_node != NULL) flatten_nodes_(kd_tree_.root_node, nodes);
+
+            IndexFileHeader_ header(get_index_file_header_());
+            header.leafSize = kd_tree_.m_leaf_max_size;
+            header.numNodes = nodes.size();
+
+            std::vector<ScalarT> bbox(2*header.dim);
+            if (header.numNodes > 0) {
+                for (size_t i = 0; i < header.dim; i++) {
+                    bbox[2*i] = kd_tree_.root_bbox[i].low;
+                    bbox[2*i+1] = kd_tree_.root_bbox[i].high;
+                }
+            }
+
+            std::ofstream out(file_name, std::ofstream::binary);
+            if (!out) return false;
+            out.write((const char*)&header, sizeof(IndexFileHeader_));
+            out.write((const char*)bbox.data(), bbox.size()*sizeof(ScalarT));
+            out.write((const char*)kd_tree_.vind.data(), kd_tree_.vind.size()*sizeof(size_t));
+            out.write((const char*)nodes.data(), nodes.size()*sizeof(IndexFileNode_));
+            out.close();
+            return !out.fail();
         }
 
-        void kNNSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t k, std::vector<size_t> &neighbors, std::vector<ScalarT> &distances) const {
+        // Replaces the current index with one saved by saveIndex() for the same data. The file is fully
+        // validated (format, scalar type, dimension, point count, point data checksum and tree structure)
+        // before anything is modified; returns false and keeps the current index if validation fails.
+        bool loadIndex(const std::string &file_name) {
+            std::ifstream in(file_name, std::ifstream::binary);
+            if (!in) return false;
+
+            IndexFileHeader_ header, expected(get_index_file_header_());
+            if (!in.read((char*)&header, sizeof(IndexFileHeader_))) return false;
+            if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 || header.version != expected.version ||
+                header.scalarSize != expected.scalarSize || header.indexSize != expected.indexSize || header.subset != expected.subset ||
+                header.dim != expected.dim || header.numPoints != expected.numPoints || header.dataChecksum != expected.dataChecksum ||
+                header.leafSize == 0 || (header.numPoints > 0) != (header.numNodes > 0))
+            {
+                return false;
+            }
+
+            std::vector<ScalarT> bbox(2*header.dim);
+            std::vector<size_t> vind(header.numPoints);
+            std::vector<IndexFileNode_> nodes(header.numNodes);
+            in.read((char*)bbox.data(), bbox.size()*sizeof(ScalarT));
+            in.read((char*)vind.data(), vind.size()*sizeof(size_t));
+            in.read((char*)nodes.data(), nodes.size()*sizeof(IndexFileNode_));
+            if (!in) return false;
+
+            if (subset_) {
+                // The permutation must cover exactly the current subset
+                std::vector<size_t> sorted_vind(vind), subset(kd_tree_.vind);
+                std::sort(sorted_vind.begin(), sorted_vind.end());
+                std::sort(subset.begin(), subset.end());
+                if (sorted_vind != subset) return false;
+            } else {
+                for (size_t i = 0; i < vind.size(); i++) {
+                    if (vind[i] >= header.numPoints) return false;
+                }
+            }
+            size_t pos = 0;
+            if (!nodes.empty() && (!validate_nodes_(nodes, pos, header.dim, header.numPoints) || pos != nodes.size())) return false;
+
+            kd_tree_.freeIndex(kd_tree_);
+            subtree_pools_.clear();
+            kd_tree_.m_size = header.numPoints;
+            kd_tree_.m_size_at_index_build = header.numPoints;
+            kd_tree_.m_leaf_max_size = header.leafSize;
+            kd_tree_.vind.swap(vind);
+            kd_tree_.root_bbox.resize(header.dim);
+            for (size_t i = 0; i < header.dim; i++) {
+                kd_tree_.root_bbox[i].low = bbox[2*i];
+                kd_tree_.root_bbox[i].high = bbox[2*i+1];
+            }
+            pos = 0;
+            if (!nodes.empty()) kd_tree_.root_node = unflatten_nodes_(nodes, pos);
+            update_search_data_();
+            return true;
+        }
+
+        inline const ConstDataMatrixMap<ScalarT,EigenDim>& getPointsMatrixMap() const { return data_map_; }
+
+        inline bool hasFlatLayout() const { return flat_layout_; }
+
+        inline bool hasIndexSubset() const { return subset_; }
+
+        // Number of indexed points (the subset size for subset trees)
+        inline size_t getNumberOfPoints() const { return kd_tree_.m_size; }
+
+        // All searches take an approximation factor eps >= 0: returned neighbors are within (1 + eps) of the
+        // true distances (in the metric's units), and larger eps prunes more of the tree; eps = 0 is exact
+        void nearestNeighborSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t &neighbor, ScalarT &distance, ScalarT eps = 0) const {
+            knn_search_(query_pt.data(), 1, &neighbor, &distance, eps);
+        }
+
+        void kNNSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t k, std::vector<size_t> &neighbors, std::vector<ScalarT> &distances, ScalarT eps = 0) const {
             neighbors.resize(k);
             distances.resize(k);
-            size_t num_results = kd_tree_.knnSearch(query_pt.data(), k, neighbors.data(), distances.data());
+            if (k == 0) return;
+            size_t num_results = knn_search_(query_pt.data(), k, neighbors.data(), distances.data(), eps);
             neighbors.resize(num_results);
             distances.resize(num_results);
         }
 
-        void radiusSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, ScalarT radius, std::vector<size_t> &neighbors, std::vector<ScalarT> &distances) const {
+        void radiusSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, ScalarT radius, std::vector<size_t> &neighbors, std::vector<ScalarT> &distances, ScalarT eps = 0) const {
             std::vector<std::pair<size_t,ScalarT> > matches;
-            matches.reserve(data_map_.cols());
-            size_t num_results = kd_tree_.radiusSearch(query_pt.data(), radius, matches, params_);
-            neighbors.resize(num_results);
-            distances.resize(num_results);
-            for (size_t i = 0; i < num_results; i++) {
-                neighbors[i] = matches[i].first;
-                distances[i] = matches[i].second;
+            radius_search_(query_pt, radius, matches, neighbors, distances, eps);
+        }
+
+        void kNNInRadiusSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t k, ScalarT radius, std::vector<size_t> &neighbors, std::vector<ScalarT> &distances, ScalarT eps = 0) const {
+            neighbors.resize(k);
+            distances.resize(k);
+            if (k == 0) return;
+            KNNInRadiusResultSet<ScalarT,size_t> result_set(k, radius);
+            result_set.init(neighbors.data(), distances.data());
+            find_neighbors_(query_pt.data(), result_set, get_search_params_(eps));
+            neighbors.resize(result_set.size());
+            distances.resize(result_set.size());
+        }
+
+        // Searches that write into a reusable context
+        inline void kNNSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t k, SearchContext<ScalarT> &context, ScalarT eps = 0) const {
+            kNNSearch(query_pt, k, context.neighbors, context.distances, eps);
+        }
+
+        inline void radiusSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, ScalarT radius, SearchContext<ScalarT> &context, ScalarT eps = 0) const {
+            radius_search_(query_pt, radius, context.matches, context.neighbors, context.distances, eps);
+        }
+
+        inline void kNNInRadiusSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t k, ScalarT radius, SearchContext<ScalarT> &context, ScalarT eps = 0) const {
+            kNNInRadiusSearch(query_pt, k, radius, context.neighbors, context.distances, eps);
+        }
+
+        // Number of points within radius of query_pt, without writing out their indices or distances
+        size_t radiusCount(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, ScalarT radius, ScalarT eps = 0) const {
+            RadiusCountResultSet<ScalarT,size_t> result_set(radius);
+            find_neighbors_(query_pt.data(), result_set, get_search_params_(eps));
+            return result_set.size();
+        }
+
+        // Points inside the axis-aligned box [min_pt, max_pt] (bounds included, in coordinate units for any
+        // metric), in no particular order; subtrees that lie inside the box are taken whole, without
+        // testing their points
+        void boxSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &min_pt, const Eigen::Matrix<ScalarT,EigenDim,1> &max_pt, std::vector<size_t> &neighbors) const {
+            neighbors.clear();
+            box_search_(min_pt.data(), max_pt.data(), &neighbors);
+        }
+
+        size_t boxCount(const Eigen::Matrix<ScalarT,EigenDim,1> &min_pt, const Eigen::Matrix<ScalarT,EigenDim,1> &max_pt) const {
+            return box_search_(min_pt.data(), max_pt.data(), NULL);
+        }
+
+        // Batched searches: all queries are processed in parallel and results are returned in flat form
+        void kNNSearch(const ConstDataMatrixMap<ScalarT,EigenDim> &queries, size_t k, NeighborhoodSet<ScalarT> &results, ScalarT eps = 0) const {
+            // Every query gets exactly min(k, #points) neighbors, so output slots are known in advance
+            size_t num_queries = queries.cols();
+            size_t k_eff = std::min(k, kd_tree_.m_size);
+            results.offsets.resize(num_queries + 1);
+            results.indices.resize(num_queries*k_eff);
+            results.distances.resize(num_queries*k_eff);
+#pragma omp parallel for
+            for (size_t i = 0; i < num_queries; i++) {
+                results.offsets[i] = i*k_eff;
+                if (k_eff > 0) knn_search_(queries.col(i).data(), k_eff, &results.indices[i*k_eff], &results.distances[i*k_eff], eps);
+            }
+            results.offsets[num_queries] = num_queries*k_eff;
+        }
+
+        void radiusCount(const ConstDataMatrixMap<ScalarT,EigenDim> &queries, ScalarT radius, std::vector<size_t> &counts, ScalarT eps = 0) const {
+            counts.resize(queries.cols());
+#pragma omp parallel for
+            for (size_t i = 0; i < counts.size(); i++) {
+                RadiusCountResultSet<ScalarT,size_t> result_set(radius);
+                find_neighbors_(queries.col(i).data(), result_set, get_search_params_(eps));
+                counts[i] = result_set.size();
             }
         }
 
-        void kNNInRadiusSearch(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, size_t k, ScalarT radius, std::vector<size_t> &neighbors, std::vector<ScalarT> &distances) const {
-            KDTree::kNNSearch(query_pt, k, neighbors, distances);
-            size_t ind = neighbors.size() - 1;
-            while (ind >= 0 && distances[ind] >= radius) ind--;
-            neighbors.resize(ind+1);
-            distances.resize(ind+1);
-//            KDTree::radiusSearch(query_pt, radius, neighbors, distances);
-//            if (neighbors.size() > k) {
-//                neighbors.resize(k);
-//                distances.resize(k);
-//            }
+        // Tree traversal with a user-supplied nanoflann-style result set (size, full, worstDist, addPoint)
+        template <class ResultSetT>
+        inline void findNeighbors(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, ResultSetT &result_set, ScalarT eps = 0) const {
+            find_neighbors_(query_pt.data(), result_set, get_search_params_(eps));
         }
 
-        inline void search(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, std::vector<size_t> &neighbors, std::vector<ScalarT> &distances, const Neighborhood &nh) const {
-            switch (nh.type) {
-                case NeighborhoodType::KNN:
-                    kNNSearch(query_pt, nh.maxNumberOfNeighbors, neighbors, distances);
-                    break;
-                case NeighborhoodType::RADIUS:
-                    radiusSearch(query_pt, nh.radius, neighbors, distances);
-                    break;
-                case NeighborhoodType::KNN_IN_RADIUS:
-                    kNNInRadiusSearch(query_pt, nh.maxNumberOfNeighbors, nh.radius, neighbors, distances);
-                    break;
+        // Batched k nearest neighbor search that traverses a tree over the queries together with this one, so
+        // that nearby queries share pruning decisions. Only the point partition of query_tree is used: node
+        // bounds are recomputed from queries on every call, so a query tree built once can be reused after its
+        // points have moved (e.g. under a rigid transform). queries must have as many points as query_tree was
+        // built on, and query_tree must not be a subset tree (otherwise this falls back to the batched
+        // kNNSearch()). Results are as in the batched
+        // kNNSearch(). The metric must be a sum of per-dimension terms that grow with the coordinate difference
+        // (L1 and the L2 adaptors).
+        template <template <class> class QueryDistAdaptor>
+        void dualTreeKNNSearch(const KDTree<ScalarT,EigenDim,QueryDistAdaptor> &query_tree, const ConstDataMatrixMap<ScalarT,EigenDim> &queries, size_t k, NeighborhoodSet<ScalarT> &results, ScalarT eps = 0) const {
+            size_t num_queries = queries.cols();
+            if (query_tree.subset_ || query_tree.kd_tree_.vind.size() != num_queries) {
+                kNNSearch(queries, k, results, eps);
+                return;
+            }
+
+            size_t k_eff = std::min(k, kd_tree_.m_size);
+            results.offsets.resize(num_queries + 1);
+            results.indices.resize(num_queries*k_eff);
+            results.distances.resize(num_queries*k_eff);
+            for (size_t i = 0; i <= num_queries; i++) {
+                results.offsets[i] = i*k_eff;
+            }
+            if (num_queries == 0 || k_eff == 0) return;
+
+            DualTreeNodes_ query_nodes, ref_nodes;
+            build_dual_tree_nodes_(query_tree.kd_tree_.root_node, query_tree.kd_tree_.vind, queries, query_nodes);
+            build_dual_tree_nodes_(kd_tree_.root_node, kd_tree_.vind, data_map_, ref_nodes);
+
+            DualTreeSearch_ search = {&query_nodes, &ref_nodes, &query_tree.kd_tree_.vind, &queries,
+                                      std::vector<KNNInRadiusResultSet<ScalarT,size_t> >(num_queries, KNNInRadiusResultSet<ScalarT,size_t>(k_eff, std::numeric_limits<ScalarT>::max())),
+                                      std::vector<DistanceType_>(query_nodes.nodes.size(), std::numeric_limits<DistanceType_>::max()),
+                                      1 + (float)eps};
+            for (size_t i = 0; i < num_queries; i++) {
+                search.resultSets[i].init(&results.indices[i*k_eff], &results.distances[i*k_eff]);
+            }
+
+            // Query subtrees are searched in parallel (about four per thread); each owns its queries' results
+            size_t max_subtrees = 1;
+#ifdef _OPENMP
+            if (omp_get_max_threads() > 1) max_subtrees = 4*omp_get_max_threads();
+#endif
+            std::vector<size_t> subtrees(1, 0), next_level;
+            while (subtrees.size() < max_subtrees) {
+                next_level.clear();
+                for (size_t i = 0; i < subtrees.size(); i++) {
+                    const DualTreeNode_ &node(query_nodes.nodes[subtrees[i]]);
+                    if (node.child1 == 0) {
+                        next_level.emplace_back(subtrees[i]);
+                    } else {
+                        next_level.emplace_back(node.child1);
+                        next_level.emplace_back(node.child2);
+                    }
+                }
+                if (next_level.size() == subtrees.size()) break;
+                subtrees.swap(next_level);
+            }
+
+#pragma omp parallel for schedule(dynamic)
+            for (size_t i = 0; i < subtrees.size(); i++) {
+                dual_tree_search_(search, subtrees[i], 0);
             }
         }
 
+        // Dual-tree search for the points query_tree was built on
+        template <template <class> class QueryDistAdaptor>
+        inline void dualTreeKNNSearch(const KDTree<ScalarT,EigenDim,QueryDistAdaptor> &query_tree, size_t k, NeighborhoodSet<ScalarT> &results, ScalarT eps = 0) const {
+            dualTreeKNNSearch(query_tree, query_tree.getPointsMatrixMap(), k, results, eps);
+        }
+
     private:
+        template <typename, ptrdiff_t, template <class> class> friend class KDTree;
+
         typedef nanoflann::KDTreeSingleIndexAdaptor<DistAdaptor<KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim> >, KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim>, EigenDim> TreeType_;
 
         ConstDataMatrixMap<ScalarT,EigenDim> data_map_;
         const KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim> mat_to_kd_;
         TreeType_ kd_tree_;
         nanoflann::SearchParams params_;
+        std::vector<std::unique_ptr<nanoflann::PooledAllocator> > subtree_pools_;
+
+        typedef KDTreeLeafBlockTraits<DistAdaptor<KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim> > > LeafBlockTraits_;
+
+        // Points in leaf order (row i is point vind[i]), padded with BlockSize zero rows; only kept for
+        // distance adaptors with block leaf scans
+        Eigen::Matrix<ScalarT,Eigen::Dynamic,EigenDim> leaf_points_;
+
+        // Flat layout: internal nodes are followed by their first child, leaves refer to a range of the
+        // permutation, and flat_points_ holds the points in leaf order (column i is point vind[i]; not needed
+        // with block leaf scans, which read leaf_points_)
+        struct FlatNode_ {
+            size_t first;       // Second child for internal nodes, range begin for leaves
+            size_t last;        // Range end for leaves
+            int divfeat;        // -1 for leaves
+            ScalarT divlow;
+            ScalarT divhigh;
+        };
+
+        bool flat_layout_;
+        bool subset_;
+        std::vector<FlatNode_> flat_nodes_;
+        Eigen::Matrix<ScalarT,EigenDim,Eigen::Dynamic> flat_points_;
+
+        typedef typename TreeType_::BoundingBox BoundingBox_;
+        typedef typename TreeType_::DistanceType DistanceType_;
+
+        // Part of the point permutation whose subtree is yet to be built; the subtree root is stored in *node
+        struct PendingSubtree_ {
+            size_t left;
+            size_t right;
+            BoundingBox_ *bbox;
+            typename TreeType_::NodePtr *node;
+        };
+
+        // Split node of the upper tree levels, whose bounds are set after both of its subtrees are built
+        struct UpperNode_ {
+            typename TreeType_::NodePtr node;
+            BoundingBox_ *bbox;
+            BoundingBox_ *left_bbox;
+            BoundingBox_ *right_bbox;
+        };
+
+        // Parallel equivalent of nanoflann's buildIndex(), producing the same tree. The upper levels are split
+        // breadth-first (the nodes of each level in parallel, on disjoint parts of the permutation), until
+        // there are about four subtrees per thread; the subtrees are then built in parallel, each from its own
+        // node pool, and the bounds of the upper nodes are finally combined bottom-up.
+        void build_index_() {
+            size_t num_points = mat_to_kd_.kdtree_get_point_count();
+            size_t dim = data_map_.rows();
+            kd_tree_.freeIndex(kd_tree_);
+            subtree_pools_.clear();
+            kd_tree_.m_size = num_points;
+            kd_tree_.m_size_at_index_build = num_points;
+            std::vector<size_t> &vind(kd_tree_.vind);
+            vind.resize(num_points);
+            for (size_t i = 0; i < num_points; i++) vind[i] = (subset_) ? mat_to_kd_.indices[i] : i;
+            if (num_points == 0) return;
+
+            BoundingBox_ &root_bbox(kd_tree_.root_bbox);
+            root_bbox.resize(dim);
+            for (size_t d = 0; d < dim; d++) {
+                root_bbox[d].low = root_bbox[d].high = data_map_(d,vind[0]);
+            }
+            for (size_t i = 1; i < num_points; i++) {
+                for (size_t d = 0; d < dim; d++) {
+                    if (data_map_(d,vind[i]) < root_bbox[d].low) root_bbox[d].low = data_map_(d,vind[i]);
+                    if (data_map_(d,vind[i]) > root_bbox[d].high) root_bbox[d].high = data_map_(d,vind[i]);
+                }
+            }
+
+            size_t max_subtrees = 1;
+#ifdef _OPENMP
+            if (omp_get_max_threads() > 1) max_subtrees = 4*omp_get_max_threads();
+#endif
+
+            std::deque<BoundingBox_> bboxes;
+            std::vector<UpperNode_> upper_nodes;
+            std::vector<PendingSubtree_> subtrees;
+            std::vector<PendingSubtree_> level(1), next_level;
+            level[0].left = 0;
+            level[0].right = num_points;
+            level[0].bbox = &root_bbox;
+            level[0].node = &kd_tree_.root_node;
+
+            std::vector<char> is_split;
+            std::vector<size_t> split_idx;
+            std::vector<int> split_feat;
+            std::vector<DistanceType_> split_val;
+            while (!level.empty() && subtrees.size() + 2*level.size() <= max_subtrees) {
+                is_split.assign(level.size(), 0);
+                split_idx.resize(level.size());
+                split_feat.resize(level.size());
+                split_val.resize(level.size());
+#pragma omp parallel for schedule(dynamic)
+                for (size_t j = 0; j < level.size(); j++) {
+                    if (level[j].right - level[j].left <= kd_tree_.m_leaf_max_size) continue;
+                    kd_tree_.middleSplit_(kd_tree_, &kd_tree_.vind[0] + level[j].left, level[j].right - level[j].left, split_idx[j], split_feat[j], split_val[j], *level[j].bbox);
+                    is_split[j] = 1;
+                }
+
+                next_level.clear();
+                for (size_t j = 0; j < level.size(); j++) {
+                    if (!is_split[j]) {
+                        subtrees.emplace_back(level[j]);
+                        continue;
+                    }
+                    UpperNode_ upper;
+                    upper.node = kd_tree_.pool.template allocate<typename TreeType_::Node>();
+                    upper.node->node_type.sub.divfeat = split_feat[j];
+                    upper.bbox = level[j].bbox;
+                    bboxes.emplace_back(*level[j].bbox);
+                    upper.left_bbox = &bboxes.back();
+                    (*upper.left_bbox)[split_feat[j]].high = split_val[j];
+                    bboxes.emplace_back(*level[j].bbox);
+                    upper.right_bbox = &bboxes.back();
+                    (*upper.right_bbox)[split_feat[j]].low = split_val[j];
+                    *level[j].node = upper.node;
+                    upper_nodes.emplace_back(upper);
+
+                    PendingSubtree_ child1 = {level[j].left, level[j].left + split_idx[j], upper.left_bbox, &upper.node->child1};
+                    PendingSubtree_ child2 = {level[j].left + split_idx[j], level[j].right, upper.right_bbox, &upper.node->child2};
+                    next_level.emplace_back(child1);
+                    next_level.emplace_back(child2);
+                }
+                level.swap(next_level);
+            }
+            subtrees.insert(subtrees.end(), level.begin(), level.end());
+
+            // The first subtree is built from the tree's own pool, which is not used concurrently
+            for (size_t i = 1; i < subtrees.size(); i++) {
+                subtree_pools_.emplace_back(new nanoflann::PooledAllocator);
+            }
+#pragma omp parallel for schedule(dynamic)
+            for (size_t i = 0; i < subtrees.size(); i++) {
+                nanoflann::PooledAllocator &pool((i == 0) ? kd_tree_.pool : *subtree_pools_[i-1]);
+                *subtrees[i].node = divide_tree_(pool, subtrees[i].left, subtrees[i].right, *subtrees[i].bbox);
+            }
+
+            // Upper nodes were created level by level, so children are visited before their parents
+            for (size_t j = upper_nodes.size(); j > 0; j--) {
+                const UpperNode_ &upper(upper_nodes[j-1]);
+                int cutfeat = upper.node->node_type.sub.divfeat;
+                upper.node->node_type.sub.divlow = (*upper.left_bbox)[cutfeat].high;
+                upper.node->node_type.sub.divhigh = (*upper.right_bbox)[cutfeat].low;
+                for (size_t d = 0; d < dim; d++) {
+                    (*upper.bbox)[d].low = std::min((*upper.left_bbox)[d].low, (*upper.right_bbox)[d].low);
+                    (*upper.bbox)[d].high = std::max((*upper.left_bbox)[d].high, (*upper.right_bbox)[d].high);
+                }
+            }
+        }
+
+        // nanoflann's divideTree(), allocating from the given pool
+        typename TreeType_::NodePtr divide_tree_(nanoflann::PooledAllocator &pool, size_t left, size_t right, BoundingBox_ &bbox) {
+            typename TreeType_::NodePtr node = pool.template allocate<typename TreeType_::Node>();
+            size_t dim = data_map_.rows();
+
+            if (right - left <= kd_tree_.m_leaf_max_size) {
+                node->child1 = node->child2 = NULL;
+                node->node_type.lr.left = left;
+                node->node_type.lr.right = right;
+                for (size_t d = 0; d < dim; d++) {
+                    bbox[d].low = bbox[d].high = data_map_(d,kd_tree_.vind[left]);
+                }
+                for (size_t k = left + 1; k < right; k++) {
+                    for (size_t d = 0; d < dim; d++) {
+                        ScalarT val = data_map_(d,kd_tree_.vind[k]);
+                        if (bbox[d].low > val) bbox[d].low = val;
+                        if (bbox[d].high < val) bbox[d].high = val;
+                    }
+                }
+            } else {
+                size_t idx;
+                int cutfeat;
+                DistanceType_ cutval;
+                kd_tree_.middleSplit_(kd_tree_, &kd_tree_.vind[0] + left, right - left, idx, cutfeat, cutval, bbox);
+
+                node->node_type.sub.divfeat = cutfeat;
+
+                BoundingBox_ left_bbox(bbox);
+                left_bbox[cutfeat].high = cutval;
+                node->child1 = divide_tree_(pool, left, left + idx, left_bbox);
+
+                BoundingBox_ right_bbox(bbox);
+                right_bbox[cutfeat].low = cutval;
+                node->child2 = divide_tree_(pool, left + idx, right, right_bbox);
+
+                node->node_type.sub.divlow = left_bbox[cutfeat].high;
+                node->node_type.sub.divhigh = right_bbox[cutfeat].low;
+
+                for (size_t d = 0; d < dim; d++) {
+                    bbox[d].low = std::min(left_bbox[d].low, right_bbox[d].low);
+                    bbox[d].high = std::max(left_bbox[d].high, right_bbox[d].high);
+                }
+            }
+
+            return node;
+        }
+
+        // Index file layout: header, root bounding box (low/high per dimension), point permutation, and
+        // the tree nodes in preorder; all values are stored in native byte order
+        struct IndexFileHeader_ {
+            char magic[8];
+            uint32_t version;
+            uint32_t scalarSize;
+            uint32_t indexSize;
+            uint32_t subset;    // 1 for trees over an index subset
+            uint64_t dim;
+            uint64_t numPoints;
+            uint64_t leafSize;
+            uint64_t numNodes;
+            uint64_t dataChecksum;
+        };
+
+        struct IndexFileNode_ {
+            int64_t divfeat;    // -1 for leaves
+            uint64_t left;      // Leaf point range [left, right) into the permutation
+            uint64_t right;
+            ScalarT divlow;
+            ScalarT divhigh;
+        };
+
+        typedef typename TreeType_::Node TreeNode_;
+
+        inline IndexFileHeader_ get_index_file_header_() const {
+            IndexFileHeader_ header;
+            std::memset(&header, 0, sizeof(IndexFileHeader_));
+            std::memcpy(header.magic, "CILKDTRE", sizeof(header.magic));
+            header.version = 1;
+            header.scalarSize = sizeof(ScalarT);
+            header.indexSize = sizeof(size_t);
+            header.dim = data_map_.rows();
+            header.subset = (subset_) ? 1 : 0;
+            header.numPoints = kd_tree_.m_size;
+
+            // FNV-1a over (up to) 1024 evenly spaced points (of a subset, in index order), to reject indices
+            // built on different data
+            std::vector<size_t> subset;
+            if (subset_) {
+                subset = kd_tree_.vind;
+                std::sort(subset.begin(), subset.end());
+            }
+            uint64_t hash = 14695981039346656037ULL;
+            size_t num_points = kd_tree_.m_size;
+            size_t step = std::max(num_points/1024, (size_t)1);
+            for (size_t i = 0; i < num_points; i += step) {
+                const unsigned char * bytes = (const unsigned char *)data_map_.col((subset_) ? subset[i] : i).data();
+                for (size_t j = 0; j < data_map_.rows()*sizeof(ScalarT); j++) {
+                    hash = (hash ^ bytes[j])*1099511628211ULL;
+                }
+            }
+            header.dataChecksum = hash;
+            return header;
+        }
+
+        void flatten_nodes_(const TreeNode_ * node, std::vector<IndexFileNode_> &nodes) const {
+            IndexFileNode_ rec;
+            std::memset(&rec, 0, sizeof(IndexFileNode_));
+            if (node->child1 == NULL && node->child2 == NULL) {
+                rec.divfeat = -1;
+                rec.left = node->node_type.lr.left;
+                rec.right = node->node_type.lr.right;
+                nodes.emplace_back(rec);
+            } else {
+                rec.divfeat = node->node_type.sub.divfeat;
+                rec.divlow = node->node_type.sub.divlow;
+                rec.divhigh = node->node_type.sub.divhigh;
+                nodes.emplace_back(rec);
+                flatten_nodes_(node->child1, nodes);
+                flatten_nodes_(node->child2, nodes);
+            }
+        }
+
+        // Checks that the preorder node sequence starting at pos forms a well-formed subtree
+        bool validate_nodes_(const std::vector<IndexFileNode_> &nodes, size_t &pos, size_t dim, size_t num_points) const {
+            if (pos >= nodes.size()) return false;
+            const IndexFileNode_ &rec(nodes[pos++]);
+            if (rec.divfeat < 0) return rec.divfeat == -1 && rec.left <= rec.right && rec.right <= num_points;
+            return (size_t)rec.divfeat < dim && validate_nodes_(nodes, pos, dim, num_points) && validate_nodes_(nodes, pos, dim, num_points);
+        }
+
+        TreeNode_ * unflatten_nodes_(const std::vector<IndexFileNode_> &nodes, size_t &pos) {
+            const IndexFileNode_ &rec(nodes[pos++]);
+            TreeNode_ * node = kd_tree_.pool.template allocate<TreeNode_>();
+            if (rec.divfeat < 0) {
+                node->node_type.lr.left = rec.left;
+                node->node_type.lr.right = rec.right;
+                node->child1 = node->child2 = NULL;
+            } else {
+                node->node_type.sub.divfeat = (int)rec.divfeat;
+                node->node_type.sub.divlow = rec.divlow;
+                node->node_type.sub.divhigh = rec.divhigh;
+                node->child1 = unflatten_nodes_(nodes, pos);
+                node->child2 = unflatten_nodes_(nodes, pos);
+            }
+            return node;
+        }
+
+        inline nanoflann::SearchParams get_search_params_(ScalarT eps) const {
+            nanoflann::SearchParams params(params_);
+            params.eps = (float)eps;
+            return params;
+        }
+
+        inline size_t knn_search_(const ScalarT * query_pt, size_t k, size_t * neighbors, ScalarT * distances, ScalarT eps) const {
+            nanoflann::KNNResultSet<ScalarT,size_t> result_set(k);
+            result_set.init(neighbors, distances);
+            find_neighbors_(query_pt, result_set, get_search_params_(eps));
+            return result_set.size();
+        }
+
+        // Rebuilds the leaf-ordered point copies and the flat node array after the index has changed
+        void update_search_data_() {
+            size_t num_points = kd_tree_.m_size;
+            if (LeafBlockTraits_::Enabled) {
+                leaf_points_.setZero(num_points + LeafBlockTraits_::BlockSize, data_map_.rows());
+#pragma omp parallel for
+                for (size_t i = 0; i < num_points; i++) {
+                    leaf_points_.row(i) = data_map_.col(kd_tree_.vind[i]).transpose();
+                }
+            }
+
+            flat_nodes_.clear();
+            flat_points_.resize(data_map_.rows(), 0);
+            if (!flat_layout_) return;
+            if (kd_tree_.root_node != NULL) flatten_search_nodes_(kd_tree_.root_node);
+            if (!LeafBlockTraits_::Enabled) {
+                flat_points_.resize(data_map_.rows(), num_points);
+#pragma omp parallel for
+                for (size_t i = 0; i < num_points; i++) {
+                    flat_points_.col(i) = data_map_.col(kd_tree_.vind[i]);
+                }
+            }
+        }
+
+        // Appends the subtree of node to flat_nodes_ in depth-first order
+        void flatten_search_nodes_(const TreeNode_ * node) {
+            size_t ind = flat_nodes_.size();
+            flat_nodes_.emplace_back();
+            if (node->child1 == NULL && node->child2 == NULL) {
+                FlatNode_ leaf = {node->node_type.lr.left, node->node_type.lr.right, -1, 0, 0};
+                flat_nodes_[ind] = leaf;
+            } else {
+                flatten_search_nodes_(node->child1);
+                FlatNode_ split = {flat_nodes_.size(), 0, node->node_type.sub.divfeat, node->node_type.sub.divlow, node->node_type.sub.divhigh};
+                flat_nodes_[ind] = split;
+                flatten_search_nodes_(node->child2);
+            }
+        }
+
+        template <class ResultSetT>
+        inline void find_neighbors_(const ScalarT * query_pt, ResultSetT &result_set, const nanoflann::SearchParams &params) const {
+            if (!flat_layout_ && !LeafBlockTraits_::Enabled) {
+                kd_tree_.findNeighbors(result_set, query_pt, params);
+                return;
+            }
+            if (kd_tree_.m_size == 0) return;
+            typename TreeType_::distance_vector_t dists;
+            dists.assign(data_map_.rows(), 0);
+            DistanceType_ distsq = kd_tree_.computeInitialDistances(kd_tree_, query_pt, dists);
+            if (flat_layout_) {
+                search_flat_level_(result_set, query_pt, 0, distsq, dists, 1 + params.eps);
+            } else {
+                search_level_(result_set, query_pt, kd_tree_.root_node, distsq, dists, 1 + params.eps);
+            }
+        }
+
+        // search_level_() over the flat node array
+        template <class ResultSetT>
+        bool search_flat_level_(ResultSetT &result_set, const ScalarT * query_pt, size_t node_ind, DistanceType_ mindistsq, typename TreeType_::distance_vector_t &dists, float eps_error) const {
+            const FlatNode_ &node(flat_nodes_[node_ind]);
+            if (node.divfeat < 0) {
+                return scan_leaf_(result_set, query_pt, node.first, node.last);
+            }
+
+            int idx = node.divfeat;
+            ScalarT val = query_pt[idx];
+            DistanceType_ diff1 = val - node.divlow;
+            DistanceType_ diff2 = val - node.divhigh;
+
+            size_t best_child;
+            size_t other_child;
+            DistanceType_ cut_dist;
+            if ((diff1 + diff2) < 0) {
+                best_child = node_ind + 1;
+                other_child = node.first;
+                cut_dist = kd_tree_.distance.accum_dist(val, node.divhigh, idx);
+            } else {
+                best_child = node.first;
+                other_child = node_ind + 1;
+                cut_dist = kd_tree_.distance.accum_dist(val, node.divlow, idx);
+            }
+
+            if (!search_flat_level_(result_set, query_pt, best_child, mindistsq, dists, eps_error)) return false;
+
+            DistanceType_ dst = dists[idx];
+            mindistsq = mindistsq + cut_dist - dst;
+            dists[idx] = cut_dist;
+            if (mindistsq*eps_error <= result_set.worstDist()) {
+                if (!search_flat_level_(result_set, query_pt, other_child, mindistsq, dists, eps_error)) return false;
+            }
+            dists[idx] = dst;
+            return true;
+        }
+
+        // nanoflann's searchLevel(), with leaves scanned in blocks from leaf_points_
+        template <class ResultSetT>
+        bool search_level_(ResultSetT &result_set, const ScalarT * query_pt, const TreeNode_ * node, DistanceType_ mindistsq, typename TreeType_::distance_vector_t &dists, float eps_error) const {
+            if (node->child1 == NULL && node->child2 == NULL) {
+                return scan_leaf_(result_set, query_pt, node->node_type.lr.left, node->node_type.lr.right);
+            }
+
+            int idx = node->node_type.sub.divfeat;
+            ScalarT val = query_pt[idx];
+            DistanceType_ diff1 = val - node->node_type.sub.divlow;
+            DistanceType_ diff2 = val - node->node_type.sub.divhigh;
+
+            const TreeNode_ * best_child;
+            const TreeNode_ * other_child;
+            DistanceType_ cut_dist;
+            if ((diff1 + diff2) < 0) {
+                best_child = node->child1;
+                other_child = node->child2;
+                cut_dist = kd_tree_.distance.accum_dist(val, node->node_type.sub.divhigh, idx);
+            } else {
+                best_child = node->child2;
+                other_child = node->child1;
+                cut_dist = kd_tree_.distance.accum_dist(val, node->node_type.sub.divlow, idx);
+            }
+
+            if (!search_level_(result_set, query_pt, best_child, mindistsq, dists, eps_error)) return false;
+
+            DistanceType_ dst = dists[idx];
+            mindistsq = mindistsq + cut_dist - dst;
+            dists[idx] = cut_dist;
+            if (mindistsq*eps_error <= result_set.worstDist()) {
+                if (!search_level_(result_set, query_pt, other_child, mindistsq, dists, eps_error)) return false;
+            }
+            dists[idx] = dst;
+            return true;
+        }
+
+        // Offers the points of the permutation range [left, right) to the result set, in blocks if supported
+        template <class ResultSetT>
+        inline bool scan_leaf_(ResultSetT &result_set, const ScalarT * query_pt, size_t left, size_t right) const {
+            DistanceType_ worst_dist = result_set.worstDist();
+            if (LeafBlockTraits_::Enabled) {
+                ScalarT block_dists[LeafBlockTraits_::BlockSize];
+                for (size_t b = left; b < right; b += LeafBlockTraits_::BlockSize) {
+                    LeafBlockTraits_::evalLeafBlock(query_pt, leaf_points_, b, block_dists);
+                    size_t block_end = std::min(b + LeafBlockTraits_::BlockSize, right);
+                    for (size_t i = b; i < block_end; i++) {
+                        if (block_dists[i-b] < worst_dist && !result_set.addPoint(block_dists[i-b], kd_tree_.vind[i])) return false;
+                    }
+                }
+            } else if (flat_layout_) {
+                size_t dim = data_map_.rows();
+                for (size_t i = left; i < right; i++) {
+                    const ScalarT * point = flat_points_.col(i).data();
+                    DistanceType_ dist = 0;
+                    for (size_t d = 0; d < dim; d++) {
+                        dist += kd_tree_.distance.accum_dist(query_pt[d], point[d], d);
+                    }
+                    if (dist < worst_dist && !result_set.addPoint(dist, kd_tree_.vind[i])) return false;
+                }
+            } else {
+                for (size_t i = left; i < right; i++) {
+                    DistanceType_ dist = kd_tree_.distance.evalMetric(query_pt, kd_tree_.vind[i], data_map_.rows());
+                    if (dist < worst_dist && !result_set.addPoint(dist, kd_tree_.vind[i])) return false;
+                }
+            }
+            return true;
+        }
+
+        // Tree node for dual-tree traversal, with the tight bounding box of its points
+        struct DualTreeNode_ {
+            size_t begin;       // Point range [begin, end) into the tree's permutation
+            size_t end;
+            size_t child1;      // 0 for leaves (the root is never a child)
+            size_t child2;
+        };
+
+        struct DualTreeNodes_ {
+            std::vector<DualTreeNode_> nodes;
+            std::vector<ScalarT> lower;     // Bounding box corners, dim values per node
+            std::vector<ScalarT> upper;
+        };
+
+        struct DualTreeSearch_ {
+            const DualTreeNodes_ *queryNodes;
+            const DualTreeNodes_ *refNodes;
+            const std::vector<size_t> *queryPermutation;
+            const ConstDataMatrixMap<ScalarT,EigenDim> *queries;
+            std::vector<KNNInRadiusResultSet<ScalarT,size_t> > resultSets;
+            std::vector<DistanceType_> bounds;      // Per query node: largest k-th neighbor distance among its queries
+            float epsError;
+        };
+
+        // Flattens the subtree of node in preorder and returns its index; bounds are computed from points
+        template <class NodeT, class PointsT>
+        static size_t build_dual_tree_nodes_(const NodeT * node, const std::vector<size_t> &vind, const PointsT &points, DualTreeNodes_ &res) {
+            size_t dim = points.rows();
+            size_t ind = res.nodes.size();
+            res.nodes.emplace_back();
+            res.lower.resize((ind + 1)*dim, std::numeric_limits<ScalarT>::max());
+            res.upper.resize((ind + 1)*dim, std::numeric_limits<ScalarT>::lowest());
+            if (node->child1 == NULL && node->child2 == NULL) {
+                DualTreeNode_ leaf = {node->node_type.lr.left, node->node_type.lr.right, 0, 0};
+                res.nodes[ind] = leaf;
+                for (size_t i = leaf.begin; i < leaf.end; i++) {
+                    for (size_t d = 0; d < dim; d++) {
+                        res.lower[ind*dim + d] = std::min(res.lower[ind*dim + d], points(d,vind[i]));
+                        res.upper[ind*dim + d] = std::max(res.upper[ind*dim + d], points(d,vind[i]));
+                    }
+                }
+            } else {
+                size_t child1 = build_dual_tree_nodes_(node->child1, vind, points, res);
+                size_t child2 = build_dual_tree_nodes_(node->child2, vind, points, res);
+                DualTreeNode_ split = {res.nodes[child1].begin, res.nodes[child2].end, child1, child2};
+                res.nodes[ind] = split;
+                for (size_t d = 0; d < dim; d++) {
+                    res.lower[ind*dim + d] = std::min(res.lower[child1*dim + d], res.lower[child2*dim + d]);
+                    res.upper[ind*dim + d] = std::max(res.upper[child1*dim + d], res.upper[child2*dim + d]);
+                }
+            }
+            return ind;
+        }
+
+        // Lower bound on the distance between any two points of the query and reference nodes
+        inline DistanceType_ dual_tree_node_distance_(const DualTreeSearch_ &search, size_t query_node, size_t ref_node) const {
+            size_t dim = data_map_.rows();
+            const ScalarT * q_lower = &search.queryNodes->lower[query_node*dim];
+            const ScalarT * q_upper = &search.queryNodes->upper[query_node*dim];
+            const ScalarT * r_lower = &search.refNodes->lower[ref_node*dim];
+            const ScalarT * r_upper = &search.refNodes->upper[ref_node*dim];
+            DistanceType_ dist = 0;
+            for (size_t d = 0; d < dim; d++) {
+                ScalarT gap = std::max(q_lower[d] - r_upper[d], r_lower[d] - q_upper[d]);
+                if (gap > 0) dist += kd_tree_.distance.accum_dist(gap, (ScalarT)0, d);
+            }
+            return dist;
+        }
+
+        // Node pairs whose distance exceeds the query node's bound (the largest k-th neighbor distance of its
+        // queries) are pruned. The query node is split first, unless it is a leaf or much smaller than the
+        // reference node: the bound of a large query node is too loose to prune much. Reference children are
+        // visited closest first, and bounds of split query nodes are tightened on the way back.
+        void dual_tree_search_(DualTreeSearch_ &search, size_t query_node, size_t ref_node) const {
+            const DualTreeNode_ &q(search.queryNodes->nodes[query_node]);
+            const DualTreeNode_ &r(search.refNodes->nodes[ref_node]);
+
+            if (q.child1 == 0 && r.child1 == 0) {
+                size_t dim = data_map_.rows();
+                const ScalarT * r_lower = &search.refNodes->lower[ref_node*dim];
+                const ScalarT * r_upper = &search.refNodes->upper[ref_node*dim];
+                DistanceType_ bound = 0;
+                for (size_t i = q.begin; i < q.end; i++) {
+                    size_t query_ind = (*search.queryPermutation)[i];
+                    KNNInRadiusResultSet<ScalarT,size_t> &result_set(search.resultSets[query_ind]);
+                    const ScalarT * query_pt = search.queries->col(query_ind).data();
+                    DistanceType_ dist = 0;
+                    for (size_t d = 0; d < dim; d++) {
+                        ScalarT gap = std::max(query_pt[d] - r_upper[d], r_lower[d] - query_pt[d]);
+                        if (gap > 0) dist += kd_tree_.distance.accum_dist(gap, (ScalarT)0, d);
+                    }
+                    if (dist*search.epsError <= result_set.worstDist()) scan_leaf_(result_set, query_pt, r.begin, r.end);
+                    bound = std::max(bound, result_set.worstDist());
+                }
+                search.bounds[query_node] = bound;
+                return;
+            }
+
+            if (q.child1 == 0 || (r.child1 != 0 && r.end - r.begin > 64*(q.end - q.begin))) {
+                size_t first = r.child1, second = r.child2;
+                DistanceType_ dist_first = dual_tree_node_distance_(search, query_node, first);
+                DistanceType_ dist_second = dual_tree_node_distance_(search, query_node, second);
+                if (dist_second < dist_first) {
+                    std::swap(first, second);
+                    std::swap(dist_first, dist_second);
+                }
+                if (dist_first*search.epsError <= search.bounds[query_node]) dual_tree_search_(search, query_node, first);
+                if (dist_second*search.epsError <= search.bounds[query_node]) dual_tree_search_(search, query_node, second);
+            } else {
+                if (dual_tree_node_distance_(search, q.child1, ref_node)*search.epsError <= search.bounds[q.child1]) dual_tree_search_(search, q.child1, ref_node);
+                if (dual_tree_node_distance_(search, q.child2, ref_node)*search.epsError <= search.bounds[q.child2]) dual_tree_search_(search, q.child2, ref_node);
+                search.bounds[query_node] = std::max(search.bounds[q.child1], search.bounds[q.child2]);
+            }
+        }
+
+        // Box query over the pointer-based nodes, narrowing bbox at every split (the first subtree ends at
+        // divlow and the second one starts at divhigh); with NULL neighbors, points are only counted
+        size_t box_search_(const ScalarT * min_pt, const ScalarT * max_pt, std::vector<size_t> * neighbors) const {
+            if (kd_tree_.root_node == NULL || kd_tree_.m_size == 0) return 0;
+            BoundingBox_ bbox(kd_tree_.root_bbox);
+            return box_search_level_(kd_tree_.root_node, bbox, min_pt, max_pt, neighbors);
+        }
+
+        size_t box_search_level_(const TreeNode_ * node, BoundingBox_ &bbox, const ScalarT * min_pt, const ScalarT * max_pt, std::vector<size_t> * neighbors) const {
+            size_t dim = data_map_.rows();
+            bool contained = true;
+            for (size_t d = 0; d < dim; d++) {
+                if (bbox[d].low > max_pt[d] || bbox[d].high < min_pt[d]) return 0;
+                if (bbox[d].low < min_pt[d] || bbox[d].high > max_pt[d]) contained = false;
+            }
+
+            if (contained) {
+                // The points of a subtree form a contiguous range of the permutation
+                const TreeNode_ * first = node;
+                while (first->child1 != NULL) first = first->child1;
+                const TreeNode_ * last = node;
+                while (last->child2 != NULL) last = last->child2;
+                size_t left = first->node_type.lr.left;
+                size_t right = last->node_type.lr.right;
+                if (neighbors != NULL) neighbors->insert(neighbors->end(), kd_tree_.vind.begin() + left, kd_tree_.vind.begin() + right);
+                return right - left;
+            }
+
+            if (node->child1 == NULL && node->child2 == NULL) {
+                size_t count = 0;
+                for (size_t i = node->node_type.lr.left; i < node->node_type.lr.right; i++) {
+                    const ScalarT * point = data_map_.col(kd_tree_.vind[i]).data();
+                    size_t d = 0;
+                    while (d < dim && point[d] >= min_pt[d] && point[d] <= max_pt[d]) d++;
+                    if (d < dim) continue;
+                    if (neighbors != NULL) neighbors->emplace_back(kd_tree_.vind[i]);
+                    count++;
+                }
+                return count;
+            }
+
+            int idx = node->node_type.sub.divfeat;
+            DistanceType_ high = bbox[idx].high;
+            bbox[idx].high = node->node_type.sub.divlow;
+            size_t count = box_search_level_(node->child1, bbox, min_pt, max_pt, neighbors);
+            bbox[idx].high = high;
+            DistanceType_ low = bbox[idx].low;
+            bbox[idx].low = node->node_type.sub.divhigh;
+            count += box_search_level_(node->child2, bbox, min_pt, max_pt, neighbors);
+            bbox[idx].low = low;
+            return count;
+        }
+
+        // Result buffers are cleared but never shrunk, so their capacity is reused across calls
+        inline void radius_search_(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, ScalarT radius, std::vector<std::pair<size_t,ScalarT> > &matches, std::vector<size_t> &neighbors, std::vector<ScalarT> &distances, ScalarT eps) const {
+            nanoflann::RadiusResultSet<ScalarT,size_t> result_set(radius, matches);
+            find_neighbors_(query_pt.data(), result_set, get_search_params_(eps));
+            if (params_.sorted) std::sort(matches.begin(), matches.end(), nanoflann::IndexDist_Sorter());
+            size_t num_results = matches.size();
+            neighbors.resize(num_results);
+            distances.resize(num_results);
+            for (size_t i = 0; i < num_results; i++) {
+                neighbors[i] = matches[i].first;
+                distances[i] = matches[i].second;
+            }
+        }
     };
 
     typedef KDTree<float,2,KDTreeDistanceAdaptors::L2> KDTree2D;
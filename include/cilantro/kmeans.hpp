@@ -106,7 +106,8 @@ namespace cilantro {
                         for (size_t j = 0; j < num_clusters; j++) {
                             // Resolved at compile time
                             if (std::is_same<DistAdaptor<KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim> >, KDTreeDistanceAdaptors::L2<KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim> > >::value ||
-                                std::is_same<DistAdaptor<KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim> >, KDTreeDistanceAdaptors::L2Simple<KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim> > >::value)
+                                std::is_same<DistAdaptor<KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim> >, KDTreeDistanceAdaptors::L2Simple<KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim> > >::value ||
+                                std::is_same<DistAdaptor<KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim> >, KDTreeDistanceAdaptors::L2Vectorized<KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim> > >::value)
                             {
                                 dist = (cluster_centroids_[j] - data_map_.col(i)).squaredNorm();
                             } else {
@@ -152,7 +153,8 @@ namespace cilantro {
                         if (cluster_index_map_[j] == max_ind) {
                             // Resolved at compile time
                             if (std::is_same<DistAdaptor<KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim> >, KDTreeDistanceAdaptors::L2<KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim> > >::value ||
-                                std::is_same<DistAdaptor<KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim> >, KDTreeDistanceAdaptors::L2Simple<KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim> > >::value)
+                                std::is_same<DistAdaptor<KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim> >, KDTreeDistanceAdaptors::L2Simple<KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim> > >::value ||
+                                std::is_same<DistAdaptor<KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim> >, KDTreeDistanceAdaptors::L2Vectorized<KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim> > >::value)
                             {
                                 dist = (old_centroid - data_map_.col(j)).squaredNorm();
                             } else {
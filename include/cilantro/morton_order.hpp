@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <cilantro/point_cloud.hpp>
+
+namespace cilantro {
+    // Morton (Z-order) codes: coordinates are quantized to 21 bits per axis over the bounding cube of the points
+    // and their bits are interleaved (x in the lowest bit), so points that are close in space mostly get close codes
+    std::vector<uint64_t> computeMortonCodes(const std::vector<Eigen::Vector3f> &points);
+
+    // Permutation that sorts the points by Morton code: position i of the sorted order holds points[order[i]]
+    std::vector<size_t> getMortonOrder(const std::vector<Eigen::Vector3f> &points);
+
+    // Reorders the points, normals and colors of the cloud by Morton code and returns the permutation that was
+    // applied (point i of the sorted cloud was point permutation[i] of the input). On a sorted cloud, both the
+    // queries of batched searches and their neighbors are close in memory.
+    std::vector<size_t> sortByMortonOrder(PointCloud &cloud);
+}
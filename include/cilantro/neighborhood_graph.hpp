@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cilantro/neighborhood_search.hpp>
+
+namespace cilantro {
+    // Precomputed neighborhoods of a set of points (node i is point i), stored in flat (CSR) form and built
+    // once by a batched (parallel) search, so that several algorithms running on the same cloud can share
+    // them instead of repeating the searches. Distances and the neighborhood radius are in the distance
+    // units of the index that built the graph (squared distances for the L2 adaptors).
+    template <typename ScalarT>
+    class NeighborhoodGraph {
+    public:
+        NeighborhoodGraph() {}
+
+        // Neighborhoods of the index's own points (the index must provide getPointsMatrixMap(), as KDTree and
+        // HashGrid do)
+        template <class SearchIndexT>
+        NeighborhoodGraph(const SearchIndexT &search_index, const Neighborhood<ScalarT> &nh) {
+            build(search_index, search_index.getPointsMatrixMap(), nh);
+        }
+
+        // Neighborhoods of the given points, which must be the points the index was built on for the graph to
+        // be used by the algorithms
+        template <class SearchIndexT, class PointsT>
+        NeighborhoodGraph(const SearchIndexT &search_index, const PointsT &points, const Neighborhood<ScalarT> &nh) {
+            build(search_index, points, nh);
+        }
+
+        ~NeighborhoodGraph() {}
+
+        template <class SearchIndexT, class PointsT>
+        NeighborhoodGraph& build(const SearchIndexT &search_index, const PointsT &points, const Neighborhood<ScalarT> &nh) {
+            neighborhood_ = nh;
+            search_index.search(points, neighborhoods_, nh);
+            return *this;
+        }
+
+        inline const Neighborhood<ScalarT>& getNeighborhood() const { return neighborhood_; }
+        inline const NeighborhoodSet<ScalarT>& getNeighborhoodSet() const { return neighborhoods_; }
+
+        inline size_t getNumberOfNodes() const { return neighborhoods_.size(); }
+        inline size_t getNumberOfEdges() const { return neighborhoods_.indices.size(); }
+
+        inline size_t getNeighborhoodSize(size_t i) const { return neighborhoods_.getNeighborhoodSize(i); }
+        inline const size_t * getNeighborIndices(size_t i) const { return neighborhoods_.getNeighborIndices(i); }
+        inline const ScalarT * getNeighborDistances(size_t i) const { return neighborhoods_.getNeighborDistances(i); }
+
+    private:
+        Neighborhood<ScalarT> neighborhood_;
+        NeighborhoodSet<ScalarT> neighborhoods_;
+    };
+}
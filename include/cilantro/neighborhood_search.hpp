@@ -0,0 +1,250 @@
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <cilantro/data_matrix_map.hpp>
+
+namespace cilantro {
+    enum struct NeighborhoodType {KNN, RADIUS, KNN_IN_RADIUS};
+
+    // radius is in the distance units of the search index it is used with (squared distances for KDTree and
+    // the other indices with the L2 adaptors), for every consumer of the neighborhood (searches,
+    // NeighborhoodGraph, NormalEstimation::estimateNormals). epsilon is the approximation factor of the
+    // search (0 for exact search); indices that do not support approximate search ignore it
+    template <typename ScalarT>
+    struct Neighborhood {
+        inline Neighborhood() : type(NeighborhoodType::KNN), maxNumberOfNeighbors(1), epsilon(0) {}
+        inline Neighborhood(size_t knn, ScalarT radius, ScalarT epsilon = 0) : type(NeighborhoodType::KNN_IN_RADIUS), maxNumberOfNeighbors(knn), radius(radius), epsilon(epsilon) {}
+        inline Neighborhood(NeighborhoodType type, size_t knn, ScalarT radius, ScalarT epsilon = 0) : type(type), maxNumberOfNeighbors(knn), radius(radius), epsilon(epsilon) {}
+
+        NeighborhoodType type;
+        size_t maxNumberOfNeighbors;
+        ScalarT radius;
+        ScalarT epsilon;
+    };
+
+    // Neighborhoods of a batch of queries in flat (CSR) form: the neighbors of query i are stored in
+    // indices[offsets[i]..offsets[i+1]) and distances[offsets[i]..offsets[i+1])
+    template <typename ScalarT>
+    struct NeighborhoodSet {
+        std::vector<size_t> offsets;
+        std::vector<size_t> indices;
+        std::vector<ScalarT> distances;
+
+        inline size_t size() const { return (offsets.empty()) ? 0 : offsets.size() - 1; }
+        inline bool empty() const { return size() == 0; }
+        inline size_t getNeighborhoodSize(size_t i) const { return offsets[i+1] - offsets[i]; }
+        inline const size_t * getNeighborIndices(size_t i) const { return indices.data() + offsets[i]; }
+        inline const ScalarT * getNeighborDistances(size_t i) const { return distances.data() + offsets[i]; }
+
+        inline NeighborhoodSet& clear() {
+            offsets.clear();
+            indices.clear();
+            distances.clear();
+            return *this;
+        }
+    };
+
+    // k nearest neighbors result set whose search ball is capped by radius from the start, so that tree
+    // branches outside the radius are pruned during traversal; radius is in the metric's distance units
+    // (squared distance for L2)
+    template <typename DistanceT, typename IndexT = size_t>
+    class KNNInRadiusResultSet {
+    public:
+        inline KNNInRadiusResultSet(size_t capacity, DistanceT radius) : indices_(NULL), dists_(NULL), capacity_(capacity), count_(0), radius_(radius) {}
+
+        inline void init(IndexT * indices, DistanceT * dists) {
+            indices_ = indices;
+            dists_ = dists;
+            count_ = 0;
+        }
+
+        inline size_t size() const { return count_; }
+
+        inline bool full() const { return count_ == capacity_; }
+
+        // Sorted insertion, as in nanoflann::KNNResultSet
+        inline bool addPoint(DistanceT dist, IndexT index) {
+            if (dist >= worstDist()) return true;
+            size_t i;
+            for (i = count_; i > 0; --i) {
+                if (dists_[i-1] > dist) {
+                    if (i < capacity_) {
+                        dists_[i] = dists_[i-1];
+                        indices_[i] = indices_[i-1];
+                    }
+                } else break;
+            }
+            if (i < capacity_) {
+                dists_[i] = dist;
+                indices_[i] = index;
+            }
+            if (count_ < capacity_) count_++;
+            return true;
+        }
+
+        inline DistanceT worstDist() const { return (count_ < capacity_) ? radius_ : dists_[capacity_-1]; }
+
+    private:
+        IndexT * indices_;
+        DistanceT * dists_;
+        size_t capacity_;
+        size_t count_;
+        DistanceT radius_;
+    };
+
+    // Radius result set that only counts the points within radius (in the metric's distance units)
+    template <typename DistanceT, typename IndexT = size_t>
+    class RadiusCountResultSet {
+    public:
+        inline RadiusCountResultSet(DistanceT radius) : count_(0), radius_(radius) {}
+
+        inline void init() { count_ = 0; }
+
+        inline size_t size() const { return count_; }
+
+        inline bool full() const { return true; }
+
+        inline bool addPoint(DistanceT dist, IndexT /*index*/) {
+            if (dist < radius_) count_++;
+            return true;
+        }
+
+        inline DistanceT worstDist() const { return radius_; }
+
+    private:
+        size_t count_;
+        DistanceT radius_;
+    };
+
+    // Reusable search buffers (one per thread); once they have grown to the required size, searches that
+    // write into a context perform no heap allocations
+    template <typename ScalarT>
+    struct SearchContext {
+        std::vector<size_t> neighbors;
+        std::vector<ScalarT> distances;
+        std::vector<std::pair<size_t,ScalarT> > matches;
+
+        inline size_t size() const { return neighbors.size(); }
+    };
+
+    // Query API shared by all spatial indices (CRTP). SearchIndexT must provide single-query kNNSearch,
+    // radiusSearch and kNNInRadiusSearch overloads that write either into neighbor/distance vectors or into
+    // a SearchContext, with a trailing approximation factor; this class adds neighborhood dispatching and
+    // batched searches on top of them.
+    template <class SearchIndexT, typename ScalarT, ptrdiff_t EigenDim>
+    class NeighborhoodSearchBase {
+    public:
+        typedef cilantro::NeighborhoodType NeighborhoodType;
+        typedef cilantro::Neighborhood<ScalarT> Neighborhood;
+
+        inline void search(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, std::vector<size_t> &neighbors, std::vector<ScalarT> &distances, const Neighborhood &nh) const {
+            switch (nh.type) {
+                case NeighborhoodType::KNN:
+                    derived_().kNNSearch(query_pt, nh.maxNumberOfNeighbors, neighbors, distances, nh.epsilon);
+                    break;
+                case NeighborhoodType::RADIUS:
+                    derived_().radiusSearch(query_pt, nh.radius, neighbors, distances, nh.epsilon);
+                    break;
+                case NeighborhoodType::KNN_IN_RADIUS:
+                    derived_().kNNInRadiusSearch(query_pt, nh.maxNumberOfNeighbors, nh.radius, neighbors, distances, nh.epsilon);
+                    break;
+            }
+        }
+
+        inline void search(const Eigen::Matrix<ScalarT,EigenDim,1> &query_pt, SearchContext<ScalarT> &context, const Neighborhood &nh) const {
+            switch (nh.type) {
+                case NeighborhoodType::KNN:
+                    derived_().kNNSearch(query_pt, nh.maxNumberOfNeighbors, context, nh.epsilon);
+                    break;
+                case NeighborhoodType::RADIUS:
+                    derived_().radiusSearch(query_pt, nh.radius, context, nh.epsilon);
+                    break;
+                case NeighborhoodType::KNN_IN_RADIUS:
+                    derived_().kNNInRadiusSearch(query_pt, nh.maxNumberOfNeighbors, nh.radius, context, nh.epsilon);
+                    break;
+            }
+        }
+
+        // Batched searches: all queries are processed in parallel and results are returned in flat form
+        void kNNSearch(const ConstDataMatrixMap<ScalarT,EigenDim> &queries, size_t k, NeighborhoodSet<ScalarT> &results, ScalarT eps = 0) const {
+            const SearchIndexT &index(derived_());
+            batch_search_(queries, results, [&index,k,eps](const Eigen::Matrix<ScalarT,EigenDim,1> &q, SearchContext<ScalarT> &c) { index.kNNSearch(q, k, c, eps); });
+        }
+
+        void radiusSearch(const ConstDataMatrixMap<ScalarT,EigenDim> &queries, ScalarT radius, NeighborhoodSet<ScalarT> &results, ScalarT eps = 0) const {
+            const SearchIndexT &index(derived_());
+            batch_search_(queries, results, [&index,radius,eps](const Eigen::Matrix<ScalarT,EigenDim,1> &q, SearchContext<ScalarT> &c) { index.radiusSearch(q, radius, c, eps); });
+        }
+
+        void kNNInRadiusSearch(const ConstDataMatrixMap<ScalarT,EigenDim> &queries, size_t k, ScalarT radius, NeighborhoodSet<ScalarT> &results, ScalarT eps = 0) const {
+            const SearchIndexT &index(derived_());
+            batch_search_(queries, results, [&index,k,radius,eps](const Eigen::Matrix<ScalarT,EigenDim,1> &q, SearchContext<ScalarT> &c) { index.kNNInRadiusSearch(q, k, radius, c, eps); });
+        }
+
+        inline void search(const ConstDataMatrixMap<ScalarT,EigenDim> &queries, NeighborhoodSet<ScalarT> &results, const Neighborhood &nh) const {
+            switch (nh.type) {
+                case NeighborhoodType::KNN:
+                    derived_().kNNSearch(queries, nh.maxNumberOfNeighbors, results, nh.epsilon);
+                    break;
+                case NeighborhoodType::RADIUS:
+                    derived_().radiusSearch(queries, nh.radius, results, nh.epsilon);
+                    break;
+                case NeighborhoodType::KNN_IN_RADIUS:
+                    derived_().kNNInRadiusSearch(queries, nh.maxNumberOfNeighbors, nh.radius, results, nh.epsilon);
+                    break;
+            }
+        }
+
+    protected:
+        inline const SearchIndexT& derived_() const { return *static_cast<const SearchIndexT*>(this); }
+
+        // Variable-size neighborhoods: queries are split in fixed-size blocks that are searched in parallel into
+        // block-local buffers, which are then concatenated in query order (independent of the thread count)
+        template <class SearchFunT>
+        void batch_search_(const ConstDataMatrixMap<ScalarT,EigenDim> &queries, NeighborhoodSet<ScalarT> &results, const SearchFunT &search_fun) const {
+            const size_t block_size = 256;
+            size_t num_queries = queries.cols();
+            size_t num_blocks = (num_queries + block_size - 1)/block_size;
+
+            results.offsets.resize(num_queries + 1);
+            std::vector<std::vector<size_t> > block_indices(num_blocks);
+            std::vector<std::vector<ScalarT> > block_distances(num_blocks);
+
+            SearchContext<ScalarT> context;
+#pragma omp parallel for schedule(dynamic) private (context)
+            for (size_t b = 0; b < num_blocks; b++) {
+                size_t end = std::min((b + 1)*block_size, num_queries);
+                for (size_t i = b*block_size; i < end; i++) {
+                    search_fun(queries.col(i), context);
+                    results.offsets[i] = context.neighbors.size();
+                    block_indices[b].insert(block_indices[b].end(), context.neighbors.begin(), context.neighbors.end());
+                    block_distances[b].insert(block_distances[b].end(), context.distances.begin(), context.distances.end());
+                }
+            }
+
+            // Exclusive prefix sum over neighborhood sizes
+            size_t total = 0;
+            std::vector<size_t> block_offsets(num_blocks);
+            for (size_t b = 0; b < num_blocks; b++) {
+                block_offsets[b] = total;
+                size_t end = std::min((b + 1)*block_size, num_queries);
+                for (size_t i = b*block_size; i < end; i++) {
+                    size_t count = results.offsets[i];
+                    results.offsets[i] = total;
+                    total += count;
+                }
+            }
+            results.offsets[num_queries] = total;
+
+            results.indices.resize(total);
+            results.distances.resize(total);
+#pragma omp parallel for
+            for (size_t b = 0; b < num_blocks; b++) {
+                std::copy(block_indices[b].begin(), block_indices[b].end(), results.indices.begin() + block_offsets[b]);
+                std::copy(block_distances[b].begin(), block_distances[b].end(), results.distances.begin() + block_offsets[b]);
+            }
+        }
+    };
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cilantro/voxel_grid.hpp>
+
+namespace cilantro {
+    // Point-to-distribution NDT (Magnusson, 2009). The destination points are binned by a VoxelGrid of the
+    // given resolution and every bin with enough points is modeled as a Gaussian (mean and regularized
+    // covariance). Each source point is scored against the Gaussian of the bin it falls into, which is a
+    // lookup in the grid's sorted bin keys rather than a nearest neighbor search, and the summed score is
+    // maximized over the rigid transform by Newton steps with a backtracking line search.
+    class NormalDistributionsTransform {
+    public:
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        NormalDistributionsTransform(const std::vector<Eigen::Vector3f> &dst_p, const std::vector<Eigen::Vector3f> &src_p, float resolution = 1.0f);
+        NormalDistributionsTransform(const PointCloud &dst, const PointCloud &src, float resolution = 1.0f);
+
+        ~NormalDistributionsTransform();
+
+        inline float getResolution() const { return resolution_; }
+        inline NormalDistributionsTransform& setResolution(float resolution) {
+            if (resolution != resolution_) {
+                delete_cells_();
+                iteration_count_ = 0;
+                resolution_ = resolution;
+            }
+            return *this;
+        }
+
+        // Bins with fewer destination points get no Gaussian
+        inline size_t getMinPointsPerCell() const { return min_points_per_cell_; }
+        inline NormalDistributionsTransform& setMinPointsPerCell(size_t min_points) {
+            if (min_points != min_points_per_cell_) {
+                delete_cells_();
+                iteration_count_ = 0;
+                min_points_per_cell_ = min_points;
+            }
+            return *this;
+        }
+
+        // Weight of the uniform (outlier) component of the per-point likelihood
+        inline float getOutlierRatio() const { return outlier_ratio_; }
+        inline NormalDistributionsTransform& setOutlierRatio(float outlier_ratio) {
+            iteration_count_ = 0;
+            outlier_ratio_ = outlier_ratio;
+            return *this;
+        }
+
+        // Upper bound on the norm of each Newton step (rotation in radians and translation)
+        inline float getMaxStepLength() const { return max_step_length_; }
+        inline NormalDistributionsTransform& setMaxStepLength(float step_length) {
+            iteration_count_ = 0;
+            max_step_length_ = step_length;
+            return *this;
+        }
+
+        inline size_t getMaxNumberOfIterations() const { return max_iter_; }
+        inline NormalDistributionsTransform& setMaxNumberOfIterations(size_t max_iter) {
+            iteration_count_ = 0;
+            max_iter_ = max_iter;
+            return *this;
+        }
+
+        inline float getConvergenceTolerance() const { return convergence_tol_; }
+        inline NormalDistributionsTransform& setConvergenceTolerance(float conv_tol) {
+            iteration_count_ = 0;
+            convergence_tol_ = conv_tol;
+            return *this;
+        }
+
+        inline void getInitialTransformation(Eigen::Ref<Eigen::Matrix3f> rot_mat_init, Eigen::Ref<Eigen::Vector3f> t_vec_init) const {
+            rot_mat_init = rot_mat_init_;
+            t_vec_init = t_vec_init_;
+        }
+        inline NormalDistributionsTransform& setInitialTransformation(const Eigen::Ref<const Eigen::Matrix3f> &rot_mat, const Eigen::Ref<const Eigen::Vector3f> &t_vec) {
+            iteration_count_ = 0;
+            rot_mat_init_ = orthonormalize_rotation_(rot_mat);
+            t_vec_init_ = t_vec;
+            return *this;
+        }
+
+        inline NormalDistributionsTransform& getTransformation(Eigen::Ref<Eigen::Matrix3f> rot_mat, Eigen::Ref<Eigen::Vector3f> t_vec) {
+            if (iteration_count_ == 0) estimate_transform_();
+            rot_mat = rot_mat_;
+            t_vec = t_vec_;
+            return *this;
+        }
+
+        // Mean per-point score at the estimated transformation (0 for no overlap)
+        inline float getScore() {
+            if (iteration_count_ == 0) estimate_transform_();
+            return score_;
+        }
+
+        // Number of destination bins modeled as Gaussians
+        inline size_t getNumberOfCells() {
+            build_cells_();
+            return num_valid_cells_;
+        }
+
+        inline bool hasConverged() const { return iteration_count_ > 0 && has_converged_; }
+        inline size_t getPerformedIterationsCount() const { return iteration_count_; }
+
+    private:
+        struct Cell_ {
+            Eigen::Vector3f mean;
+            Eigen::Matrix3f inverseCovariance;
+            bool valid;
+        };
+
+        // Score, gradient and Hessian (of the negated score, which is minimized) at one transformation
+        struct Derivatives_ {
+            double value;
+            Eigen::Matrix<double,6,1> gradient;
+            Eigen::Matrix<double,6,6> hessian;
+            // Hessian without the terms that can make it indefinite away from the optimum
+            Eigen::Matrix<double,6,6> hessianApprox;
+            size_t numPoints;
+        };
+
+        const std::vector<Eigen::Vector3f> *dst_points_;
+        const std::vector<Eigen::Vector3f> *src_points_;
+
+        float resolution_;
+        size_t min_points_per_cell_;
+        float outlier_ratio_;
+        float max_step_length_;
+        float convergence_tol_;
+        size_t max_iter_;
+
+        Eigen::Matrix3f rot_mat_init_;
+        Eigen::Vector3f t_vec_init_;
+
+        // Destination model: Gaussians indexed by VoxelGrid bin
+        VoxelGrid *grid_;
+        std::vector<Cell_> cells_;
+        size_t num_valid_cells_;
+
+        // Object state
+        bool has_converged_;
+        size_t iteration_count_;
+        float score_;
+
+        Eigen::Matrix3f rot_mat_;
+        Eigen::Vector3f t_vec_;
+
+        void init_params_();
+        void build_cells_();
+        void delete_cells_();
+        Eigen::Matrix3f orthonormalize_rotation_(const Eigen::Matrix3f &rot_mat) const;
+        void compute_derivatives_(const Eigen::Matrix3f &rot_mat, const Eigen::Vector3f &t_vec, Derivatives_ &res) const;
+        void estimate_transform_();
+    };
+}
@@ -1,36 +1,56 @@
 #pragma once
 
+#include <cassert>
 #include <cilantro/principal_component_analysis.hpp>
 #include <cilantro/kd_tree.hpp>
+#include <cilantro/neighborhood_graph.hpp>
 
 namespace cilantro {
-    template <typename ScalarT, ptrdiff_t EigenDim>
+    // SearchIndexT is the neighbor index used for the local neighborhoods (e.g. KDTree, or HashGrid for
+    // fixed-radius estimation); an index is only built internally if it can be constructed from the points.
+    // Alternatively, normals can be computed from a precomputed NeighborhoodGraph over the same points, in which
+    // case no index is used and only estimateNormals() is available. Calling the methods of the other mode is
+    // an error (asserted in debug builds) and yields NaN normals.
+    template <typename ScalarT, ptrdiff_t EigenDim, class SearchIndexT = KDTree<ScalarT,EigenDim,KDTreeDistanceAdaptors::L2> >
     class NormalEstimation {
     public:
         EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
         NormalEstimation(const ConstDataMatrixMap<ScalarT,EigenDim> &points)
                 : points_(points),
-                  kd_tree_ptr_(new KDTree<ScalarT,EigenDim,KDTreeDistanceAdaptors::L2>(points)),
-                  kd_tree_owned_(true),
+                  search_index_ptr_(new SearchIndexT(points)),
+                  search_index_owned_(true),
+                  graph_ptr_(NULL),
                   view_point_(Eigen::Matrix<ScalarT,EigenDim,1>::Zero())
         {}
 
-        NormalEstimation(const ConstDataMatrixMap<ScalarT,EigenDim> &points, const KDTree<ScalarT,EigenDim,KDTreeDistanceAdaptors::L2> &kd_tree)
+        NormalEstimation(const ConstDataMatrixMap<ScalarT,EigenDim> &points, const SearchIndexT &search_index)
                 : points_(points),
-                  kd_tree_ptr_(&kd_tree),
-                  kd_tree_owned_(false),
+                  search_index_ptr_(&search_index),
+                  search_index_owned_(false),
+                  graph_ptr_(NULL),
+                  view_point_(Eigen::Matrix<ScalarT,EigenDim,1>::Zero())
+        {}
+
+        NormalEstimation(const ConstDataMatrixMap<ScalarT,EigenDim> &points, const NeighborhoodGraph<ScalarT> &graph)
+                : points_(points),
+                  search_index_ptr_(NULL),
+                  search_index_owned_(false),
+                  graph_ptr_(&graph),
                   view_point_(Eigen::Matrix<ScalarT,EigenDim,1>::Zero())
         {}
 
         ~NormalEstimation() {
-            if (kd_tree_owned_) delete kd_tree_ptr_;
+            if (search_index_owned_) delete search_index_ptr_;
         }
 
         inline const Eigen::Matrix<ScalarT,EigenDim,1>& getViewPoint() const { return view_point_; }
         inline NormalEstimation& setViewPoint(const Eigen::Ref<const Eigen::Matrix<ScalarT,EigenDim,1> > &vp) { view_point_ = vp; return *this; }
 
-        std::vector<Eigen::Matrix<ScalarT,EigenDim,1> > estimateNormalsKNN(size_t num_neighbors) const {
+        std::vector<Eigen::Matrix<ScalarT,EigenDim,1> > estimateNormalsKNN(size_t num_neighbors, ScalarT eps = 0) const {
+            assert(search_index_ptr_ != NULL && "NormalEstimation was constructed from a NeighborhoodGraph");
+            if (search_index_ptr_ == NULL) return nan_normals_();
+
             std::vector<Eigen::Matrix<ScalarT,EigenDim,1> > normals(points_.cols());
             Eigen::Matrix<ScalarT,EigenDim,1> nan(Eigen::Matrix<ScalarT,EigenDim,1>::Constant(std::numeric_limits<ScalarT>::quiet_NaN()));
             if (points_.cols() < EigenDim) {
@@ -38,14 +58,14 @@ namespace cilantro {
                 return normals;
             }
 
-            std::vector<size_t> neighbors;
-            std::vector<ScalarT> distances;
-#pragma omp parallel for shared (normals) private (neighbors, distances)
-            for (size_t i = 0; i < points_.cols(); i++) {
-                kd_tree_ptr_->kNNSearch(points_.col(i), num_neighbors, neighbors, distances);
-                std::vector<Eigen::Matrix<ScalarT,EigenDim,1> > neighborhood(neighbors.size());
-                for (size_t j = 0; j < neighbors.size(); j++) {
-                    neighborhood[j] = points_.col(neighbors[j]);
+            SearchContext<ScalarT> context;
+            std::vector<Eigen::Matrix<ScalarT,EigenDim,1> > neighborhood;
+#pragma omp parallel for shared (normals) private (context, neighborhood)
+            for (size_t i = 0; i < (size_t)points_.cols(); i++) {
+                search_index_ptr_->kNNSearch(points_.col(i), num_neighbors, context, eps);
+                neighborhood.resize(context.neighbors.size());
+                for (size_t j = 0; j < context.neighbors.size(); j++) {
+                    neighborhood[j] = points_.col(context.neighbors[j]);
                 }
                 PrincipalComponentAnalysis<ScalarT,EigenDim> pca(neighborhood);
                 normals[i] = pca.getEigenVectorsMatrix().col(EigenDim-1);
@@ -58,27 +78,52 @@ namespace cilantro {
             return normals;
         }
 
-        std::vector<Eigen::Matrix<ScalarT,EigenDim,1> > estimateNormalsRadius(ScalarT radius) const {
-            ScalarT radius_sq = radius*radius;
+        // radius is a Euclidean distance
+        inline std::vector<Eigen::Matrix<ScalarT,EigenDim,1> > estimateNormalsRadius(ScalarT radius, ScalarT eps = 0) const {
+            return estimate_normals_radius_(radius*radius, eps);
+        }
+
+        inline std::vector<Eigen::Matrix<ScalarT,EigenDim,1> > estimateNormalsKNNInRadius(size_t k, ScalarT radius, ScalarT eps = 0) const {
+            return estimate_normals_knn_in_radius_(k, radius*radius, eps);
+        }
+
+        // nh.radius is in the distance units of the search index (a squared distance for KDTree with the L2
+        // adaptors), as for NeighborhoodGraph, so the same Neighborhood can be used for both
+        std::vector<Eigen::Matrix<ScalarT,EigenDim,1> > estimateNormals(const Neighborhood<ScalarT> &nh) const {
+            switch (nh.type) {
+                case NeighborhoodType::KNN:
+                    return estimateNormalsKNN(nh.maxNumberOfNeighbors, nh.epsilon);
+                case NeighborhoodType::RADIUS:
+                    return estimate_normals_radius_(nh.radius, nh.epsilon);
+                case NeighborhoodType::KNN_IN_RADIUS:
+                    return estimate_normals_knn_in_radius_(nh.maxNumberOfNeighbors, nh.radius, nh.epsilon);
+            }
+            return nan_normals_();
+        }
+
+        // Normals from the neighborhoods of the graph given at construction
+        std::vector<Eigen::Matrix<ScalarT,EigenDim,1> > estimateNormals() const {
+            assert(graph_ptr_ != NULL && "NormalEstimation was constructed without a NeighborhoodGraph");
+            if (graph_ptr_ == NULL) return nan_normals_();
+
             std::vector<Eigen::Matrix<ScalarT,EigenDim,1> > normals(points_.cols());
             Eigen::Matrix<ScalarT,EigenDim,1> nan(Eigen::Matrix<ScalarT,EigenDim,1>::Constant(std::numeric_limits<ScalarT>::quiet_NaN()));
 
-            std::vector<size_t> neighbors;
-            std::vector<ScalarT> distances;
-#pragma omp parallel for shared (normals) private (neighbors, distances)
-            for (size_t i = 0; i < points_.cols(); i++) {
-                kd_tree_ptr_->radiusSearch(points_.col(i), radius_sq, neighbors, distances);
-                if (neighbors.size() < EigenDim) {
+            std::vector<Eigen::Matrix<ScalarT,EigenDim,1> > neighborhood;
+#pragma omp parallel for shared (normals) private (neighborhood)
+            for (size_t i = 0; i < (size_t)points_.cols(); i++) {
+                const size_t num_neighbors = graph_ptr_->getNeighborhoodSize(i);
+                if (num_neighbors < EigenDim) {
                     normals[i] = nan;
                     continue;
                 }
-                std::vector<Eigen::Matrix<ScalarT,EigenDim,1> > neighborhood(neighbors.size());
-                for (size_t j = 0; j < neighbors.size(); j++) {
+                const size_t * neighbors = graph_ptr_->getNeighborIndices(i);
+                neighborhood.resize(num_neighbors);
+                for (size_t j = 0; j < num_neighbors; j++) {
                     neighborhood[j] = points_.col(neighbors[j]);
                 }
                 PrincipalComponentAnalysis<ScalarT,EigenDim> pca(neighborhood);
                 normals[i] = pca.getEigenVectorsMatrix().col(EigenDim-1);
-//                points_.col(i) = pca.reconstruct<EigenDim-1>(pca.project<EigenDim-1>(points_.col(i)));
                 if (normals[i].dot(view_point_ - points_.col(i)) < 0.0) {
                     normals[i] *= -1.0;
                 }
@@ -87,23 +132,32 @@ namespace cilantro {
             return normals;
         }
 
-        std::vector<Eigen::Matrix<ScalarT,EigenDim,1> > estimateNormalsKNNInRadius(size_t k, ScalarT radius) const {
-            ScalarT radius_sq = radius*radius;
+    private:
+        ConstDataMatrixMap<ScalarT,EigenDim> points_;
+        const SearchIndexT *search_index_ptr_;
+        bool search_index_owned_;
+        const NeighborhoodGraph<ScalarT> *graph_ptr_;
+        Eigen::Matrix<ScalarT,EigenDim,1> view_point_;
+
+        std::vector<Eigen::Matrix<ScalarT,EigenDim,1> > estimate_normals_radius_(ScalarT radius_sq, ScalarT eps) const {
+            assert(search_index_ptr_ != NULL && "NormalEstimation was constructed from a NeighborhoodGraph");
+            if (search_index_ptr_ == NULL) return nan_normals_();
+
             std::vector<Eigen::Matrix<ScalarT,EigenDim,1> > normals(points_.cols());
             Eigen::Matrix<ScalarT,EigenDim,1> nan(Eigen::Matrix<ScalarT,EigenDim,1>::Constant(std::numeric_limits<ScalarT>::quiet_NaN()));
 
-            std::vector<size_t> neighbors;
-            std::vector<ScalarT> distances;
-#pragma omp parallel for shared (normals) private (neighbors, distances)
-            for (size_t i = 0; i < points_.cols(); i++) {
-                kd_tree_ptr_->kNNInRadiusSearch(points_.col(i), k, radius_sq, neighbors, distances);
-                if (neighbors.size() < EigenDim) {
+            SearchContext<ScalarT> context;
+            std::vector<Eigen::Matrix<ScalarT,EigenDim,1> > neighborhood;
+#pragma omp parallel for shared (normals) private (context, neighborhood)
+            for (size_t i = 0; i < (size_t)points_.cols(); i++) {
+                search_index_ptr_->radiusSearch(points_.col(i), radius_sq, context, eps);
+                if (context.neighbors.size() < EigenDim) {
                     normals[i] = nan;
                     continue;
                 }
-                std::vector<Eigen::Matrix<ScalarT,EigenDim,1> > neighborhood(neighbors.size());
-                for (size_t j = 0; j < neighbors.size(); j++) {
-                    neighborhood[j] = points_.col(neighbors[j]);
+                neighborhood.resize(context.neighbors.size());
+                for (size_t j = 0; j < context.neighbors.size(); j++) {
+                    neighborhood[j] = points_.col(context.neighbors[j]);
                 }
                 PrincipalComponentAnalysis<ScalarT,EigenDim> pca(neighborhood);
                 normals[i] = pca.getEigenVectorsMatrix().col(EigenDim-1);
@@ -116,22 +170,40 @@ namespace cilantro {
             return normals;
         }
 
-        std::vector<Eigen::Matrix<ScalarT,EigenDim,1> > estimateNormals(const typename KDTree<ScalarT,EigenDim,KDTreeDistanceAdaptors::L2>::Neighborhood &nh) const {
-            switch (nh.type) {
-                case KDTree<ScalarT,EigenDim,KDTreeDistanceAdaptors::L2>::NeighborhoodType::KNN:
-                    return estimateNormalsKNN(nh.maxNumberOfNeighbors);
-                case KDTree<ScalarT,EigenDim,KDTreeDistanceAdaptors::L2>::NeighborhoodType::RADIUS:
-                    return estimateNormalsRadius(nh.radius);
-                case KDTree<ScalarT,EigenDim,KDTreeDistanceAdaptors::L2>::NeighborhoodType::KNN_IN_RADIUS:
-                    return estimateNormalsKNNInRadius(nh.maxNumberOfNeighbors, nh.radius);
+        std::vector<Eigen::Matrix<ScalarT,EigenDim,1> > estimate_normals_knn_in_radius_(size_t k, ScalarT radius_sq, ScalarT eps) const {
+            assert(search_index_ptr_ != NULL && "NormalEstimation was constructed from a NeighborhoodGraph");
+            if (search_index_ptr_ == NULL) return nan_normals_();
+
+            std::vector<Eigen::Matrix<ScalarT,EigenDim,1> > normals(points_.cols());
+            Eigen::Matrix<ScalarT,EigenDim,1> nan(Eigen::Matrix<ScalarT,EigenDim,1>::Constant(std::numeric_limits<ScalarT>::quiet_NaN()));
+
+            SearchContext<ScalarT> context;
+            std::vector<Eigen::Matrix<ScalarT,EigenDim,1> > neighborhood;
+#pragma omp parallel for shared (normals) private (context, neighborhood)
+            for (size_t i = 0; i < (size_t)points_.cols(); i++) {
+                search_index_ptr_->kNNInRadiusSearch(points_.col(i), k, radius_sq, context, eps);
+                if (context.neighbors.size() < EigenDim) {
+                    normals[i] = nan;
+                    continue;
+                }
+                neighborhood.resize(context.neighbors.size());
+                for (size_t j = 0; j < context.neighbors.size(); j++) {
+                    neighborhood[j] = points_.col(context.neighbors[j]);
+                }
+                PrincipalComponentAnalysis<ScalarT,EigenDim> pca(neighborhood);
+                normals[i] = pca.getEigenVectorsMatrix().col(EigenDim-1);
+//                points_.col(i) = pca.reconstruct<EigenDim-1>(pca.project<EigenDim-1>(points_.col(i)));
+                if (normals[i].dot(view_point_ - points_.col(i)) < 0.0) {
+                    normals[i] *= -1.0;
+                }
             }
+
+            return normals;
         }
 
-    private:
-        ConstDataMatrixMap<ScalarT,EigenDim> points_;
-        const KDTree<ScalarT,EigenDim,KDTreeDistanceAdaptors::L2> *kd_tree_ptr_;
-        bool kd_tree_owned_;
-        Eigen::Matrix<ScalarT,EigenDim,1> view_point_;
+        inline std::vector<Eigen::Matrix<ScalarT,EigenDim,1> > nan_normals_() const {
+            return std::vector<Eigen::Matrix<ScalarT,EigenDim,1> >(points_.cols(), Eigen::Matrix<ScalarT,EigenDim,1>::Constant(std::numeric_limits<ScalarT>::quiet_NaN()));
+        }
     };
 
     typedef NormalEstimation<float,2> NormalEstimation2D;
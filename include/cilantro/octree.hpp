@@ -0,0 +1,173 @@
+#pragma once
+
+#include <limits>
+#include <cilantro/neighborhood_search.hpp>
+#include <cilantro/point_cloud.hpp>
+
+namespace cilantro {
+    // Octree cell with the aggregate statistics of the points it contains; a node's points are the range
+    // [pointsBegin, pointsEnd) of Octree::getPointIndices()
+    struct OctreeNode {
+        static const size_t NO_CHILD = std::numeric_limits<size_t>::max();
+
+        Eigen::Vector3f center;
+        float halfSize;
+        size_t depth;
+        size_t pointsBegin;
+        size_t pointsEnd;
+        bool isLeaf;
+        size_t children[8];             // Node index per octant (NO_CHILD if empty); octant bit i is set for the upper half along axis i
+        Eigen::Vector3f centroid;
+        Eigen::Matrix3f covariance;     // Normalized by the number of points
+
+        inline size_t getNumberOfPoints() const { return pointsEnd - pointsBegin; }
+    };
+
+    // Octree over the bounding cube of the points. Nodes are split until they hold at most max_leaf_size points
+    // or reach max_depth. Besides the neighbor searches shared with the other indices (radii are squared
+    // distances, as for KDTree with the L2 adaptors), it provides box queries that take or count whole
+    // subtrees at once, and level-of-detail extraction: the points grouped by octree cell at any depth.
+    // Cells are aligned to the root cube (centered on the bounding box and as large as its longest side), so
+    // they generally differ from the bins of a VoxelGrid of the same size, which are anchored at the minimum
+    // point on each axis.
+    class Octree : public NeighborhoodSearchBase<Octree,float,3> {
+    public:
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        typedef NeighborhoodSearchBase<Octree,float,3> Base;
+        typedef Base::NeighborhoodType NeighborhoodType;
+        typedef Base::Neighborhood Neighborhood;
+
+        using Base::search;
+        using Base::kNNSearch;
+        using Base::radiusSearch;
+        using Base::kNNInRadiusSearch;
+
+        Octree(const std::vector<Eigen::Vector3f> &points, size_t max_leaf_size = 16, size_t max_depth = 20);
+        Octree(const PointCloud &cloud, size_t max_leaf_size = 16, size_t max_depth = 20);
+        ~Octree() {}
+
+        inline size_t getNumberOfNodes() const { return nodes_.size(); }
+        inline const std::vector<OctreeNode>& getNodes() const { return nodes_; }
+        inline const OctreeNode& getNode(size_t node_ind) const { return nodes_[node_ind]; }
+
+        // Input point indices in octree order
+        inline const std::vector<size_t>& getPointIndices() const { return point_indices_; }
+
+        // Depth of the deepest node (the root has depth 0)
+        inline size_t getDepth() const { return depth_; }
+
+        // Edge length of the cells at the given depth
+        inline float getCellSize(size_t depth) const { return std::ldexp(2.0f*root_half_size_, -(int)depth); }
+
+        void nearestNeighborSearch(const Eigen::Vector3f &query_pt, size_t &neighbor, float &distance, float eps = 0) const;
+
+        void kNNSearch(const Eigen::Vector3f &query_pt, size_t k, std::vector<size_t> &neighbors, std::vector<float> &distances, float eps = 0) const;
+        void radiusSearch(const Eigen::Vector3f &query_pt, float radius, std::vector<size_t> &neighbors, std::vector<float> &distances, float eps = 0) const;
+        void kNNInRadiusSearch(const Eigen::Vector3f &query_pt, size_t k, float radius, std::vector<size_t> &neighbors, std::vector<float> &distances, float eps = 0) const;
+
+        // Searches that write into a reusable context
+        inline void kNNSearch(const Eigen::Vector3f &query_pt, size_t k, SearchContext<float> &context, float eps = 0) const {
+            kNNSearch(query_pt, k, context.neighbors, context.distances, eps);
+        }
+
+        inline void radiusSearch(const Eigen::Vector3f &query_pt, float radius, SearchContext<float> &context, float eps = 0) const {
+            radius_search_(query_pt, radius, context.matches, context.neighbors, context.distances, eps);
+        }
+
+        inline void kNNInRadiusSearch(const Eigen::Vector3f &query_pt, size_t k, float radius, SearchContext<float> &context, float eps = 0) const {
+            kNNInRadiusSearch(query_pt, k, radius, context.neighbors, context.distances, eps);
+        }
+
+        // Points inside the axis-aligned box [min_pt, max_pt]; nodes entirely inside the box are taken without
+        // testing their points, nodes outside it are skipped
+        void boxSearch(const Eigen::Vector3f &min_pt, const Eigen::Vector3f &max_pt, std::vector<size_t> &indices) const;
+        size_t boxCount(const Eigen::Vector3f &min_pt, const Eigen::Vector3f &max_pt) const;
+
+        // Input point indices grouped by occupied cell at the given depth (of size getCellSize(depth), aligned
+        // to the root cube), in octree order
+        std::vector<std::vector<size_t> > getLevelOfDetailPointIndices(size_t depth, size_t min_points_in_bin = 1) const;
+
+        // Cell centroids at the given depth (normals and colors are averaged as in VoxelGrid)
+        std::vector<Eigen::Vector3f> getLevelOfDetailPoints(size_t depth, size_t min_points_in_bin = 1) const;
+        PointCloud getLevelOfDetailCloud(size_t depth, size_t min_points_in_bin = 1) const;
+
+    private:
+        // Collects all points within radius
+        struct RadiusResultSet_ {
+            inline RadiusResultSet_(float radius, std::vector<std::pair<size_t,float> > &matches) : radius(radius), matches(matches) {}
+
+            inline float worstDist() const { return radius; }
+            inline bool addPoint(float dist, size_t index) {
+                matches.emplace_back(index, dist);
+                return true;
+            }
+
+            float radius;
+            std::vector<std::pair<size_t,float> > &matches;
+        };
+
+        const std::vector<Eigen::Vector3f> * input_points_;
+        const std::vector<Eigen::Vector3f> * input_normals_;
+        const std::vector<Eigen::Vector3f> * input_colors_;
+
+        size_t max_leaf_size_;
+        size_t max_depth_;
+        size_t depth_;
+        float root_half_size_;
+
+        std::vector<OctreeNode> nodes_;
+        std::vector<size_t> point_indices_;
+        Eigen::Matrix<float,3,Eigen::Dynamic> points_;     // Points in octree order
+
+        void build_();
+
+        size_t build_node_(const Eigen::Vector3f &center, float half_size, size_t depth, size_t begin, size_t end, std::vector<size_t> &buffer);
+
+        void box_search_(size_t node_ind, const Eigen::Vector3f &min_pt, const Eigen::Vector3f &max_pt, std::vector<size_t> &indices) const;
+
+        size_t box_count_(size_t node_ind, const Eigen::Vector3f &min_pt, const Eigen::Vector3f &max_pt) const;
+
+        void collect_level_of_detail_(size_t node_ind, size_t depth, size_t min_points_in_bin, std::vector<std::vector<size_t> > &groups) const;
+
+        void radius_search_(const Eigen::Vector3f &query_pt, float radius, std::vector<std::pair<size_t,float> > &matches, std::vector<size_t> &neighbors, std::vector<float> &distances, float eps) const;
+
+        // Squared distance from the query to the node's cube
+        inline float get_node_distance_(const OctreeNode &node, const Eigen::Vector3f &query_pt) const {
+            return ((query_pt - node.center).cwiseAbs().array() - node.halfSize).max(0.0f).matrix().squaredNorm();
+        }
+
+        // Depth-first traversal, visiting children closest first
+        template <class ResultSetT>
+        void find_neighbors_(size_t node_ind, const Eigen::Vector3f &query_pt, ResultSetT &result_set, float eps_error) const {
+            const OctreeNode &node(nodes_[node_ind]);
+            if (node.isLeaf) {
+                for (size_t i = node.pointsBegin; i < node.pointsEnd; i++) {
+                    float dist = (points_.col(i) - query_pt).squaredNorm();
+                    if (dist < result_set.worstDist()) result_set.addPoint(dist, point_indices_[i]);
+                }
+                return;
+            }
+
+            size_t order[8];
+            float dists[8];
+            size_t num_children = 0;
+            for (size_t o = 0; o < 8; o++) {
+                if (node.children[o] == OctreeNode::NO_CHILD) continue;
+                float dist = get_node_distance_(nodes_[node.children[o]], query_pt);
+                size_t j = num_children++;
+                while (j > 0 && dists[j-1] > dist) {
+                    dists[j] = dists[j-1];
+                    order[j] = order[j-1];
+                    j--;
+                }
+                dists[j] = dist;
+                order[j] = node.children[o];
+            }
+            for (size_t j = 0; j < num_children; j++) {
+                if (dists[j]*eps_error >= result_set.worstDist()) break;
+                find_neighbors_(order[j], query_pt, result_set, eps_error);
+            }
+        }
+    };
+}
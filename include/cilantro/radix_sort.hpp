@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+namespace cilantro {
+    // Stable LSD radix sort of unsigned integer keys, 8 bits per pass. Sorts the keys in place and returns in
+    // permutation the original position of each sorted key. Passes over bytes that are equal for all keys are
+    // skipped. Histograms and scatters run in parallel over fixed chunks of the input, so the result does not
+    // depend on the number of threads. IndexT must be able to hold keys.size() - 1.
+    template <typename KeyT, typename IndexT>
+    void radixSort(std::vector<KeyT> &keys, std::vector<IndexT> &permutation) {
+        static_assert(std::is_unsigned<KeyT>::value, "radixSort requires unsigned integer keys");
+        static_assert(std::is_integral<IndexT>::value, "radixSort requires integer permutation indices");
+
+        const size_t num_keys = keys.size();
+        permutation.resize(num_keys);
+        for (size_t i = 0; i < num_keys; i++) {
+            permutation[i] = (IndexT)i;
+        }
+        if (num_keys < 2) return;
+
+        const size_t num_buckets = 256;
+        const size_t num_chunks = std::max<size_t>(1, std::min<size_t>(64, num_keys/16384));
+        const size_t chunk_size = (num_keys + num_chunks - 1)/num_chunks;
+
+        std::vector<size_t> offsets(num_chunks*num_buckets);
+        std::vector<KeyT> keys_tmp(num_keys);
+        std::vector<IndexT> permutation_tmp(num_keys);
+
+        for (size_t shift = 0; shift < 8*sizeof(KeyT); shift += 8) {
+            std::fill(offsets.begin(), offsets.end(), 0);
+#pragma omp parallel for
+            for (size_t c = 0; c < num_chunks; c++) {
+                size_t * chunk_counts = offsets.data() + c*num_buckets;
+                const size_t end = std::min(num_keys, (c + 1)*chunk_size);
+                for (size_t i = c*chunk_size; i < end; i++) {
+                    chunk_counts[(keys[i] >> shift) & 0xFF]++;
+                }
+            }
+
+            const size_t first_bucket = (keys[0] >> shift) & 0xFF;
+            size_t first_bucket_count = 0;
+            for (size_t c = 0; c < num_chunks; c++) {
+                first_bucket_count += offsets[c*num_buckets + first_bucket];
+            }
+            if (first_bucket_count == num_keys) continue;
+
+            // Bucket-major, chunk-minor exclusive prefix sum keeps the sort stable
+            size_t sum = 0;
+            for (size_t b = 0; b < num_buckets; b++) {
+                for (size_t c = 0; c < num_chunks; c++) {
+                    const size_t count = offsets[c*num_buckets + b];
+                    offsets[c*num_buckets + b] = sum;
+                    sum += count;
+                }
+            }
+
+#pragma omp parallel for
+            for (size_t c = 0; c < num_chunks; c++) {
+                size_t * chunk_offsets = offsets.data() + c*num_buckets;
+                const size_t end = std::min(num_keys, (c + 1)*chunk_size);
+                for (size_t i = c*chunk_size; i < end; i++) {
+                    const size_t pos = chunk_offsets[(keys[i] >> shift) & 0xFF]++;
+                    keys_tmp[pos] = keys[i];
+                    permutation_tmp[pos] = permutation[i];
+                }
+            }
+            keys.swap(keys_tmp);
+            permutation.swap(permutation_tmp);
+        }
+    }
+
+    // Permutation that stably sorts the keys (the keys are left untouched)
+    template <typename KeyT>
+    std::vector<size_t> getRadixSortPermutation(const std::vector<KeyT> &keys) {
+        std::vector<KeyT> sorted_keys(keys);
+        std::vector<size_t> permutation;
+        radixSort(sorted_keys, permutation);
+        return permutation;
+    }
+}
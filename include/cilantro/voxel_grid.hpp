@@ -1,10 +1,16 @@
 #pragma once
 
-//#include <unordered_map>
-#include <map>
+#include <array>
+#include <cstdint>
 #include <cilantro/point_cloud.hpp>
 
 namespace cilantro {
+    // Points are binned by a packed 64-bit key of their integer grid coordinates (128-bit for grids over 2^64
+    // bins, up to 2^42 bins along each axis). The keys are radix sorted together with the point indices, so
+    // that every occupied bin is a contiguous span of one index array (bins in key order, with offsets into
+    // the index array). Point indices and offsets are 32-bit, so the input may hold at most 2^32 - 1 points.
+    // Inputs beyond these limits are rejected (asserted in debug builds) and give an empty grid. Downsampled
+    // outputs list the bins in the order of their first point in the input.
     class VoxelGrid {
     public:
         EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -19,51 +25,78 @@ namespace cilantro {
 
         PointCloud getDownsampledCloud(size_t min_points_in_bin = 1) const;
 
-        const std::vector<size_t>& getGridBinNeighbors(const Eigen::Vector3f &point) const;
-        const std::vector<size_t>& getGridBinNeighbors(size_t point_ind) const;
+        // Per-bin covariance of the points (scatter matrix over the point count)
+        std::vector<Eigen::Matrix3f> getDownsampledCovariances(size_t min_points_in_bin = 1) const;
 
-    private:
+        // Index of the input point closest to each bin's mean, so that outputs are actual samples
+        std::vector<size_t> getClosestToMeanIndices(size_t min_points_in_bin = 1) const;
+
+        // Index of a random input point of each bin; the choice depends only on seed and the bin
+        std::vector<size_t> getRandomPointIndices(size_t min_points_in_bin = 1, unsigned int seed = 0) const;
+
+        // Any combination of the above statistics (and the means of getDownsampledPoints) in one pass over
+        // the bins; outputs passed as NULL are not computed
+        void getDownsampledStatistics(std::vector<Eigen::Vector3f> * means,
+                                      std::vector<Eigen::Matrix3f> * covariances,
+                                      std::vector<size_t> * closest_indices,
+                                      std::vector<size_t> * random_indices,
+                                      size_t min_points_in_bin = 1,
+                                      unsigned int seed = 0) const;
+
+        std::vector<size_t> getGridBinNeighbors(const Eigen::Vector3f &point) const;
+        std::vector<size_t> getGridBinNeighbors(size_t point_ind) const;
+
+        // Bins are numbered 0..getNumberOfBins()-1 in key order; each one's point indices (in increasing
+        // order) are a span of a single array, so iterating over all bins is a sequential scan
+        inline size_t getNumberOfBins() const { return bin_keys_.size(); }
+        inline size_t getBinPointCount(size_t bin) const { return bin_offsets_[bin+1] - bin_offsets_[bin]; }
+        inline const uint32_t * getBinPointIndices(size_t bin) const { return point_indices_.data() + bin_offsets_[bin]; }
+
+        // Bin containing point, if it is occupied
+        bool findBin(const Eigen::Vector3f &point, size_t &bin) const;
 
-//    class EigenVector3iHasher_ {
-//    public:
-//        inline size_t operator()(const Eigen::Vector3i &p) const {
-//            size_t seed = 0;
-//            for (size_t i = 0; i < 3; ++i) {
-//                seed ^= std::hash<float>()(p(i)) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-//            }
-//            return seed;
-//        }
-//    };
-
-//    class EigenVector3iComparator_ {
-//    public:
-//        inline bool operator()(const Eigen::Vector3i &p1, const Eigen::Vector3i &p2) const {
-//            if (p1[0] < p2[0]) return true;
-//            if (p1[0] == p2[0]) {
-//                if (p1[1] < p2[1]) return true;
-//                if (p1[1] == p2[1]) {
-//                    return p1[2] < p2[2];
-//                } else return false;
-//            } else return false;
-//        }
-//    };
+        // Same statistics as getDownsampledStatistics, for all bins and indexed by bin (as given by findBin)
+        void getBinStatistics(std::vector<Eigen::Vector3f> * means,
+                              std::vector<Eigen::Matrix3f> * covariances,
+                              std::vector<size_t> * closest_indices = NULL,
+                              std::vector<size_t> * random_indices = NULL,
+                              unsigned int seed = 0) const;
 
+    private:
         const std::vector<Eigen::Vector3f> * input_points_;
         const std::vector<Eigen::Vector3f> * input_normals_;
         const std::vector<Eigen::Vector3f> * input_colors_;
 
         float bin_size_;
-//    Eigen::Vector3f min_pt_;
         std::array<float,3> min_pt_;
 
-        std::vector<size_t> empty_indices_;
-
-        std::map<std::array<int,3>,std::vector<size_t> > grid_lookup_table_;
-//    std::map<Eigen::Vector3i, std::vector<size_t>, EigenVector3iComparator_> grid_lookup_table_;
-//    std::unordered_map<Eigen::Vector3i, std::vector<size_t>, EigenVector3iHasher_> grid_lookup_table_;
+        // Grid coordinates are in [0, max_coords_] and packed with key_shifts_ (bit positions in a 128-bit key)
+        std::array<uint64_t,3> max_coords_;
+        std::array<int,3> key_shifts_;
 
-        std::vector<std::map<std::array<int,3>,std::vector<size_t> >::iterator> map_iterators_;
+        // Bin i holds point_indices_[bin_offsets_[i]..bin_offsets_[i+1]) (in increasing order) and has key
+        // bin_keys_[i] (increasing); bin_keys_hi_ holds the high words of wide keys (empty otherwise), which
+        // then order the bins first. bin_order_ lists the bins in output order
+        std::vector<uint64_t> bin_keys_;
+        std::vector<uint64_t> bin_keys_hi_;
+        std::vector<uint32_t> bin_offsets_;
+        std::vector<uint32_t> point_indices_;
+        std::vector<uint32_t> bin_order_;
 
         void build_lookup_table_();
+
+        bool get_bin_key_(const Eigen::Vector3f &point, uint64_t &key, uint64_t &key_hi) const;
+
+        std::vector<uint32_t> get_output_bins_(size_t min_points_in_bin) const;
+
+        void compute_statistics_(const std::vector<uint32_t> &bins,
+                                 std::vector<Eigen::Vector3f> * means,
+                                 std::vector<Eigen::Matrix3f> * covariances,
+                                 std::vector<size_t> * closest_indices,
+                                 std::vector<size_t> * random_indices,
+                                 unsigned int seed) const;
+
+        Eigen::Vector3f average_(const std::vector<Eigen::Vector3f> &vectors, size_t bin) const;
+        Eigen::Vector3f average_normal_(size_t bin) const;
     };
 }
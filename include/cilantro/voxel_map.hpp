@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <cilantro/point_cloud.hpp>
+
+namespace cilantro {
+    // Downsampled map that absorbs a stream of frames: each occupied voxel keeps running statistics of the
+    // points that fell into it (count, mean, summed normals and colors, and optionally the scatter matrix
+    // for covariances), so memory grows with the number of occupied voxels rather than of integrated
+    // points. Voxels are anchored at the world origin, with up to 2^20 voxels on either side of it along
+    // each axis (points beyond that are ignored). Normals and colors are kept as long as every integrated
+    // frame has them. Outputs list the voxels in the order they were created (eviction moves the last
+    // voxel into the freed slot).
+    class VoxelMap {
+    public:
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        VoxelMap(float bin_size, bool compute_covariances = false);
+        ~VoxelMap() {}
+
+        // Adds a frame, given in sensor coordinates and its pose in the map (or already in map coordinates)
+        VoxelMap& integrate(const PointCloud &cloud);
+        VoxelMap& integrate(const PointCloud &cloud, const Eigen::Ref<const Eigen::Matrix4f> &pose);
+
+        // Evicts voxels whose mean is farther than max_distance from center; returns the number removed
+        size_t removeDistantVoxels(const Eigen::Vector3f &center, float max_distance);
+
+        // Evicts voxels not updated by the last max_age integrated frames; returns the number removed
+        size_t removeStaleVoxels(size_t max_age);
+
+        VoxelMap& clear();
+
+        inline float getBinSize() const { return bin_size_; }
+        inline size_t getNumberOfVoxels() const { return voxels_.size(); }
+        inline size_t getNumberOfFrames() const { return num_frames_; }
+        inline bool hasNormals() const { return has_normals_ && !voxels_.empty(); }
+        inline bool hasColors() const { return has_colors_ && !voxels_.empty(); }
+        inline bool hasCovariances() const { return compute_covariances_; }
+
+        std::vector<Eigen::Vector3f> getPoints(size_t min_points_in_bin = 1) const;
+        std::vector<Eigen::Vector3f> getNormals(size_t min_points_in_bin = 1) const;
+        std::vector<Eigen::Vector3f> getColors(size_t min_points_in_bin = 1) const;
+        std::vector<size_t> getPointCounts(size_t min_points_in_bin = 1) const;
+
+        // Covariance of each voxel's points (scatter matrix over the point count); empty unless enabled
+        std::vector<Eigen::Matrix3f> getCovariances(size_t min_points_in_bin = 1) const;
+
+        PointCloud getCloud(size_t min_points_in_bin = 1) const;
+
+    private:
+        struct Voxel_ {
+            Eigen::Vector3d mean;
+            Eigen::Vector3f normalSum;
+            Eigen::Vector3f colorSum;
+            uint32_t count;
+            uint32_t lastFrame;
+        };
+
+        float bin_size_;
+        bool compute_covariances_;
+        bool has_normals_;
+        bool has_colors_;
+        size_t num_frames_;
+
+        std::vector<Voxel_> voxels_;
+        std::vector<uint64_t> voxel_keys_;
+        // Upper triangle (xx, xy, xz, yy, yz, zz) of each voxel's scatter matrix, if enabled
+        std::vector<std::array<double,6> > scatter_;
+        std::unordered_map<uint64_t,size_t> voxel_lookup_;
+
+        bool get_voxel_key_(const Eigen::Vector3f &point, uint64_t &key) const;
+
+        void remove_voxel_(size_t ind);
+
+        std::vector<size_t> get_output_voxels_(size_t min_points_in_bin) const;
+    };
+}
@@ -12,6 +12,7 @@ namespace cilantro {
               kd_tree_3d_(NULL),
               kd_tree_6d_(NULL),
               kd_tree_9d_(NULL),
+              src_kd_tree_3d_(NULL),
               corr_type_(CorrespondencesType::POINTS),
               metric_(Metric::POINT_TO_POINT),
               has_converged_(false),
@@ -31,6 +32,7 @@ namespace cilantro {
               kd_tree_3d_(NULL),
               kd_tree_6d_(NULL),
               kd_tree_9d_(NULL),
+              src_kd_tree_3d_(NULL),
               corr_type_(CorrespondencesType::POINTS),
               metric_((dst_n.size() == dst_p.size()) ? Metric::POINT_TO_PLANE : Metric::POINT_TO_POINT),
               has_converged_(false),
@@ -50,6 +52,7 @@ namespace cilantro {
               kd_tree_3d_(NULL),
               kd_tree_6d_(NULL),
               kd_tree_9d_(NULL),
+              src_kd_tree_3d_(NULL),
               corr_type_(correct_correspondences_type_(corr_type)),
               metric_((dst.hasNormals()) ? metric : Metric::POINT_TO_POINT),
               has_converged_(false),
@@ -66,15 +69,16 @@ namespace cilantro {
     void IterativeClosestPoint::build_kd_trees_() {
         switch (corr_type_) {
             case CorrespondencesType::POINTS: {
-                if (!kd_tree_3d_) kd_tree_3d_ = new KDTree<float,3,KDTreeDistanceAdaptors::L2>(*dst_points_);
+                if (!kd_tree_3d_) kd_tree_3d_ = new KDTree<float,3,KDTreeDistanceAdaptors::L2Vectorized>(*dst_points_);
+                if (!src_kd_tree_3d_) src_kd_tree_3d_ = new KDTree<float,3,KDTreeDistanceAdaptors::L2>(*src_points_);
                 break;
             }
             case CorrespondencesType::NORMALS: {
-                if (!kd_tree_3d_) kd_tree_3d_ = new KDTree<float,3,KDTreeDistanceAdaptors::L2>(*dst_normals_);
+                if (!kd_tree_3d_) kd_tree_3d_ = new KDTree<float,3,KDTreeDistanceAdaptors::L2Vectorized>(*dst_normals_);
                 break;
             }
             case CorrespondencesType::COLORS: {
-                if (!kd_tree_3d_) kd_tree_3d_ = new KDTree<float,3,KDTreeDistanceAdaptors::L2>(*dst_colors_);
+                if (!kd_tree_3d_) kd_tree_3d_ = new KDTree<float,3,KDTreeDistanceAdaptors::L2Vectorized>(*dst_colors_);
                 break;
             }
             case CorrespondencesType::POINTS_NORMALS: {
@@ -83,7 +87,7 @@ namespace cilantro {
                     Eigen::Map<Eigen::Matrix<float,6,Eigen::Dynamic> > data_map((float *)dst_data_points_6d_.data(), 6, dst_data_points_6d_.size());
                     data_map.topRows(3) = point_dist_weight_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)dst_points_->data(), 3, dst_points_->size());
                     data_map.bottomRows(3) = normal_dist_weight_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)dst_normals_->data(), 3, dst_normals_->size());
-                    kd_tree_6d_ = new KDTree<float,6,KDTreeDistanceAdaptors::L2>(dst_data_points_6d_);
+                    kd_tree_6d_ = new KDTree<float,6,KDTreeDistanceAdaptors::L2Vectorized>(dst_data_points_6d_);
                 }
                 break;
             }
@@ -93,7 +97,7 @@ namespace cilantro {
                     Eigen::Map<Eigen::Matrix<float,6,Eigen::Dynamic> > data_map((float *)dst_data_points_6d_.data(), 6, dst_data_points_6d_.size());
                     data_map.topRows(3) = point_dist_weight_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)dst_points_->data(), 3, dst_points_->size());
                     data_map.bottomRows(3) = color_dist_weight_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)dst_colors_->data(), 3, dst_colors_->size());
-                    kd_tree_6d_ = new KDTree<float,6,KDTreeDistanceAdaptors::L2>(dst_data_points_6d_);
+                    kd_tree_6d_ = new KDTree<float,6,KDTreeDistanceAdaptors::L2Vectorized>(dst_data_points_6d_);
                 }
                 break;
             }
@@ -103,7 +107,7 @@ namespace cilantro {
                     Eigen::Map<Eigen::Matrix<float,6,Eigen::Dynamic> > data_map((float *)dst_data_points_6d_.data(), 6, dst_data_points_6d_.size());
                     data_map.topRows(3) = normal_dist_weight_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)dst_normals_->data(), 3, dst_normals_->size());
                     data_map.bottomRows(3) = color_dist_weight_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)dst_colors_->data(), 3, dst_colors_->size());
-                    kd_tree_6d_ = new KDTree<float,6,KDTreeDistanceAdaptors::L2>(dst_data_points_6d_);
+                    kd_tree_6d_ = new KDTree<float,6,KDTreeDistanceAdaptors::L2Vectorized>(dst_data_points_6d_);
                 }
                 break;
             }
@@ -114,7 +118,7 @@ namespace cilantro {
                     data_map.topRows(3) = point_dist_weight_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)dst_points_->data(), 3, dst_points_->size());
                     data_map.block(3,0,3,dst_data_points_9d_.size()) = normal_dist_weight_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)dst_normals_->data(), 3, dst_normals_->size());
                     data_map.bottomRows(3) = color_dist_weight_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)dst_colors_->data(), 3, dst_colors_->size());
-                    kd_tree_9d_ = new KDTree<float,9,KDTreeDistanceAdaptors::L2>(dst_data_points_9d_);
+                    kd_tree_9d_ = new KDTree<float,9,KDTreeDistanceAdaptors::L2Vectorized>(dst_data_points_9d_);
                 }
                 break;
             }
@@ -125,9 +129,11 @@ namespace cilantro {
         delete kd_tree_3d_;
         delete kd_tree_6d_;
         delete kd_tree_9d_;
+        delete src_kd_tree_3d_;
         kd_tree_3d_ = NULL;
         kd_tree_6d_ = NULL;
         kd_tree_9d_ = NULL;
+        src_kd_tree_3d_ = NULL;
         dst_data_points_6d_.clear();
         dst_data_points_9d_.clear();
     }
@@ -179,6 +185,7 @@ namespace cilantro {
 
         corr_dist_thres_ = 0.05f;
         corr_fraction_ = 1.0f;
+        corr_search_eps_ = 0.0f;
         convergence_tol_ = 1e-3f;
         max_iter_ = 15;
         max_estimation_iter_ = 1;
@@ -196,133 +203,72 @@ namespace cilantro {
 
     void IterativeClosestPoint::find_correspondences_(std::vector<size_t>* &dst_ind, std::vector<size_t>* &src_ind) {
         float corr_thresh_squared = corr_dist_thres_*corr_dist_thres_;
-        size_t neighbor;
-        float distance;
 
-        dst_ind_all_.clear();
-        src_ind_all_.clear();
-        distances_all_.clear();
+        // Batched nearest neighbor search
         switch (corr_type_) {
             case CorrespondencesType::POINTS: {
-#pragma omp parallel for shared (dst_ind, src_ind) private (neighbor, distance)
-                for (size_t i = 0; i < src_points_trans_.size(); i++) {
-                    kd_tree_3d_->nearestNeighborSearch(src_points_trans_[i], neighbor, distance);
-                    if (distance < corr_thresh_squared) {
-#pragma omp critical
-                        {
-                            dst_ind_all_.emplace_back(neighbor);
-                            src_ind_all_.emplace_back(i);
-                            distances_all_.emplace_back(distance);
-                        }
-                    }
-                }
+                kd_tree_3d_->dualTreeKNNSearch(*src_kd_tree_3d_, src_points_trans_, 1, nn_results_, corr_search_eps_);
                 break;
             }
             case CorrespondencesType::NORMALS: {
-#pragma omp parallel for shared (dst_ind, src_ind) private (neighbor, distance)
-                for (size_t i = 0; i < src_points_trans_.size(); i++) {
-                    kd_tree_3d_->nearestNeighborSearch(rot_mat_*(*src_normals_)[i], neighbor, distance);
-                    if (distance < corr_thresh_squared) {
-#pragma omp critical
-                        {
-                            dst_ind_all_.emplace_back(neighbor);
-                            src_ind_all_.emplace_back(i);
-                            distances_all_.emplace_back(distance);
-                        }
-                    }
-                }
+                src_queries_3d_.resize(src_points_trans_.size());
+                Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)src_queries_3d_.data(), 3, src_queries_3d_.size()) = rot_mat_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)src_normals_->data(), 3, src_normals_->size());
+                kd_tree_3d_->kNNSearch(src_queries_3d_, 1, nn_results_, corr_search_eps_);
                 break;
             }
             case CorrespondencesType::COLORS: {
-#pragma omp parallel for shared (dst_ind, src_ind) private (neighbor, distance)
-                for (size_t i = 0; i < src_points_trans_.size(); i++) {
-                    kd_tree_3d_->nearestNeighborSearch((*src_colors_)[i], neighbor, distance);
-                    if (distance < corr_thresh_squared) {
-#pragma omp critical
-                        {
-                            dst_ind_all_.emplace_back(neighbor);
-                            src_ind_all_.emplace_back(i);
-                            distances_all_.emplace_back(distance);
-                        }
-                    }
-                }
+                kd_tree_3d_->kNNSearch(*src_colors_, 1, nn_results_, corr_search_eps_);
                 break;
             }
             case CorrespondencesType::POINTS_NORMALS: {
-#pragma omp parallel for shared (dst_ind, src_ind) private (neighbor, distance)
-                for (size_t i = 0; i < src_points_trans_.size(); i++) {
-                    Eigen::Matrix<float,6,1> query_pt;
-                    query_pt.head(3) = point_dist_weight_*src_points_trans_[i];
-                    query_pt.tail(3) = normal_dist_weight_*rot_mat_*(*src_normals_)[i];
-                    kd_tree_6d_->nearestNeighborSearch(query_pt, neighbor, distance);
-                    if (distance < corr_thresh_squared) {
-#pragma omp critical
-                        {
-                            dst_ind_all_.emplace_back(neighbor);
-                            src_ind_all_.emplace_back(i);
-                            distances_all_.emplace_back(distance);
-                        }
-                    }
-                }
+                src_queries_6d_.resize(src_points_trans_.size());
+                Eigen::Map<Eigen::Matrix<float,6,Eigen::Dynamic> > query_map((float *)src_queries_6d_.data(), 6, src_queries_6d_.size());
+                query_map.topRows(3) = point_dist_weight_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)src_points_trans_.data(), 3, src_points_trans_.size());
+                query_map.bottomRows(3) = normal_dist_weight_*rot_mat_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)src_normals_->data(), 3, src_normals_->size());
+                kd_tree_6d_->kNNSearch(src_queries_6d_, 1, nn_results_, corr_search_eps_);
                 break;
             }
             case CorrespondencesType::POINTS_COLORS: {
-#pragma omp parallel for shared (dst_ind, src_ind) private (neighbor, distance)
-                for (size_t i = 0; i < src_points_trans_.size(); i++) {
-                    Eigen::Matrix<float,6,1> query_pt;
-                    query_pt.head(3) = point_dist_weight_*src_points_trans_[i];
-                    query_pt.tail(3) = color_dist_weight_*(*src_colors_)[i];
-                    kd_tree_6d_->nearestNeighborSearch(query_pt, neighbor, distance);
-                    if (distance < corr_thresh_squared) {
-#pragma omp critical
-                        {
-                            dst_ind_all_.emplace_back(neighbor);
-                            src_ind_all_.emplace_back(i);
-                            distances_all_.emplace_back(distance);
-                        }
-                    }
-                }
+                src_queries_6d_.resize(src_points_trans_.size());
+                Eigen::Map<Eigen::Matrix<float,6,Eigen::Dynamic> > query_map((float *)src_queries_6d_.data(), 6, src_queries_6d_.size());
+                query_map.topRows(3) = point_dist_weight_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)src_points_trans_.data(), 3, src_points_trans_.size());
+                query_map.bottomRows(3) = color_dist_weight_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)src_colors_->data(), 3, src_colors_->size());
+                kd_tree_6d_->kNNSearch(src_queries_6d_, 1, nn_results_, corr_search_eps_);
                 break;
             }
             case CorrespondencesType::NORMALS_COLORS: {
-#pragma omp parallel for shared (dst_ind, src_ind) private (neighbor, distance)
-                for (size_t i = 0; i < src_points_trans_.size(); i++) {
-                    Eigen::Matrix<float,6,1> query_pt;
-                    query_pt.head(3) = normal_dist_weight_*rot_mat_*(*src_normals_)[i];
-                    query_pt.tail(3) = color_dist_weight_*(*src_colors_)[i];
-                    kd_tree_6d_->nearestNeighborSearch(query_pt, neighbor, distance);
-                    if (distance < corr_thresh_squared) {
-#pragma omp critical
-                        {
-                            dst_ind_all_.emplace_back(neighbor);
-                            src_ind_all_.emplace_back(i);
-                            distances_all_.emplace_back(distance);
-                        }
-                    }
-                }
+                src_queries_6d_.resize(src_points_trans_.size());
+                Eigen::Map<Eigen::Matrix<float,6,Eigen::Dynamic> > query_map((float *)src_queries_6d_.data(), 6, src_queries_6d_.size());
+                query_map.topRows(3) = normal_dist_weight_*rot_mat_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)src_normals_->data(), 3, src_normals_->size());
+                query_map.bottomRows(3) = color_dist_weight_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)src_colors_->data(), 3, src_colors_->size());
+                kd_tree_6d_->kNNSearch(src_queries_6d_, 1, nn_results_, corr_search_eps_);
                 break;
             }
             case CorrespondencesType::POINTS_NORMALS_COLORS: {
-#pragma omp parallel for shared (dst_ind, src_ind) private (neighbor, distance)
-                for (size_t i = 0; i < src_points_trans_.size(); i++) {
-                    Eigen::Matrix<float,9,1> query_pt;
-                    query_pt.head(3) = point_dist_weight_*src_points_trans_[i];
-                    query_pt.segment(3,3) = normal_dist_weight_*rot_mat_*(*src_normals_)[i];
-                    query_pt.tail(3) = color_dist_weight_*(*src_colors_)[i];
-                    kd_tree_9d_->nearestNeighborSearch(query_pt, neighbor, distance);
-                    if (distance < corr_thresh_squared) {
-#pragma omp critical
-                        {
-                            dst_ind_all_.emplace_back(neighbor);
-                            src_ind_all_.emplace_back(i);
-                            distances_all_.emplace_back(distance);
-                        }
-                    }
-                }
+                src_queries_9d_.resize(src_points_trans_.size());
+                Eigen::Map<Eigen::Matrix<float,9,Eigen::Dynamic> > query_map((float *)src_queries_9d_.data(), 9, src_queries_9d_.size());
+                query_map.topRows(3) = point_dist_weight_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)src_points_trans_.data(), 3, src_points_trans_.size());
+                query_map.block(3,0,3,src_queries_9d_.size()) = normal_dist_weight_*rot_mat_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)src_normals_->data(), 3, src_normals_->size());
+                query_map.bottomRows(3) = color_dist_weight_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)src_colors_->data(), 3, src_colors_->size());
+                kd_tree_9d_->kNNSearch(src_queries_9d_, 1, nn_results_, corr_search_eps_);
                 break;
             }
         }
 
+        // Keep correspondences within threshold (in source point order)
+        dst_ind_all_.clear();
+        src_ind_all_.clear();
+        distances_all_.clear();
+        for (size_t i = 0; i < nn_results_.size(); i++) {
+            if (nn_results_.getNeighborhoodSize(i) == 0) continue;
+            float distance = nn_results_.getNeighborDistances(i)[0];
+            if (distance < corr_thresh_squared) {
+                dst_ind_all_.emplace_back(nn_results_.getNeighborIndices(i)[0]);
+                src_ind_all_.emplace_back(i);
+                distances_all_.emplace_back(distance);
+            }
+        }
+
         if (corr_fraction_ > 0.0f && corr_fraction_ < 1.0f) {
             size_t num_corr = (size_t)std::llround(corr_fraction_*dst_ind_all_.size());
             num_corr = std::min(std::max(num_corr, (size_t)6), dst_ind_all_.size());
@@ -429,16 +375,24 @@ namespace cilantro {
         residuals.resize(src_points_->size());
         switch (req_corr_type) {
             case CorrespondencesType::POINTS: {
-                KDTree<float,3,KDTreeDistanceAdaptors::L2> *kd_tree;
+                KDTree<float,3,KDTreeDistanceAdaptors::L2Vectorized> *kd_tree;
+                KDTree<float,3,KDTreeDistanceAdaptors::L2> *src_kd_tree;
                 if (req_corr_type == corr_type_) {
                     kd_tree = kd_tree_3d_;
+                    src_kd_tree = src_kd_tree_3d_;
                 } else {
-                    kd_tree = new KDTree<float,3,KDTreeDistanceAdaptors::L2>(*dst_points_);
+                    kd_tree = new KDTree<float,3,KDTreeDistanceAdaptors::L2Vectorized>(*dst_points_);
+                    src_kd_tree = new KDTree<float,3,KDTreeDistanceAdaptors::L2>(*src_points_);
                 }
+                std::vector<Eigen::Vector3f> points_trans(src_points_->size());
+                Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)points_trans.data(), 3, points_trans.size()) = (rot_mat_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)src_points_->data(), 3, src_points_->size())).colwise() + t_vec_;
+                NeighborhoodSet<float> nn_results;
+                kd_tree->dualTreeKNNSearch(*src_kd_tree, points_trans, 1, nn_results);
 #pragma omp parallel for shared (residuals) private (neighbor, distance)
-                for (size_t i = 0; i < src_points_trans_.size(); i++) {
-                    Eigen::Vector3f pt_trans = rot_mat_*(*src_points_)[i] + t_vec_;
-                    kd_tree->nearestNeighborSearch(pt_trans, neighbor, distance);
+                for (size_t i = 0; i < points_trans.size(); i++) {
+                    const Eigen::Vector3f &pt_trans = points_trans[i];
+                    neighbor = nn_results.getNeighborIndices(i)[0];
+                    distance = nn_results.getNeighborDistances(i)[0];
                     switch (req_metric) {
                         case Metric::POINT_TO_POINT: {
                             residuals[i] = std::sqrt(distance);
@@ -460,15 +414,16 @@ namespace cilantro {
                 }
                 if (req_corr_type != corr_type_) {
                     delete kd_tree;
+                    delete src_kd_tree;
                 }
                 break;
             }
             case CorrespondencesType::NORMALS: {
-                KDTree<float,3,KDTreeDistanceAdaptors::L2> *kd_tree;
+                KDTree<float,3,KDTreeDistanceAdaptors::L2Vectorized> *kd_tree;
                 if (req_corr_type == corr_type_) {
                     kd_tree = kd_tree_3d_;
                 } else {
-                    kd_tree = new KDTree<float,3,KDTreeDistanceAdaptors::L2>(*dst_normals_);
+                    kd_tree = new KDTree<float,3,KDTreeDistanceAdaptors::L2Vectorized>(*dst_normals_);
                 }
 #pragma omp parallel for shared (residuals) private (neighbor, distance)
                 for (size_t i = 0; i < src_points_trans_.size(); i++) {
@@ -499,11 +454,11 @@ namespace cilantro {
                 break;
             }
             case CorrespondencesType::COLORS: {
-                KDTree<float,3,KDTreeDistanceAdaptors::L2> *kd_tree;
+                KDTree<float,3,KDTreeDistanceAdaptors::L2Vectorized> *kd_tree;
                 if (req_corr_type == corr_type_) {
                     kd_tree = kd_tree_3d_;
                 } else {
-                    kd_tree = new KDTree<float,3,KDTreeDistanceAdaptors::L2>(*dst_colors_);
+                    kd_tree = new KDTree<float,3,KDTreeDistanceAdaptors::L2Vectorized>(*dst_colors_);
                 }
 #pragma omp parallel for shared (residuals) private (neighbor, distance)
                 for (size_t i = 0; i < src_points_trans_.size(); i++) {
@@ -534,7 +489,7 @@ namespace cilantro {
                 break;
             }
             case CorrespondencesType::POINTS_NORMALS: {
-                KDTree<float,6,KDTreeDistanceAdaptors::L2> *kd_tree;
+                KDTree<float,6,KDTreeDistanceAdaptors::L2Vectorized> *kd_tree;
                 std::vector<Eigen::Matrix<float,6,1> > data_holder;
                 if (req_corr_type == corr_type_) {
                     kd_tree = kd_tree_6d_;
@@ -543,7 +498,7 @@ namespace cilantro {
                     Eigen::Map<Eigen::Matrix<float,6,Eigen::Dynamic> > data_map((float *)data_holder.data(), 6, data_holder.size());
                     data_map.topRows(3) = point_dist_weight_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)dst_points_->data(), 3, dst_points_->size());
                     data_map.bottomRows(3) = normal_dist_weight_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)dst_normals_->data(), 3, dst_normals_->size());
-                    kd_tree = new KDTree<float,6,KDTreeDistanceAdaptors::L2>(data_holder);
+                    kd_tree = new KDTree<float,6,KDTreeDistanceAdaptors::L2Vectorized>(data_holder);
                 }
 #pragma omp parallel for shared (residuals) private (neighbor, distance)
                 for (size_t i = 0; i < src_points_trans_.size(); i++) {
@@ -577,7 +532,7 @@ namespace cilantro {
                 break;
             }
             case CorrespondencesType::POINTS_COLORS: {
-                KDTree<float,6,KDTreeDistanceAdaptors::L2> *kd_tree;
+                KDTree<float,6,KDTreeDistanceAdaptors::L2Vectorized> *kd_tree;
                 std::vector<Eigen::Matrix<float,6,1> > data_holder;
                 if (req_corr_type == corr_type_) {
                     kd_tree = kd_tree_6d_;
@@ -586,7 +541,7 @@ namespace cilantro {
                     Eigen::Map<Eigen::Matrix<float,6,Eigen::Dynamic> > data_map((float *)data_holder.data(), 6, data_holder.size());
                     data_map.topRows(3) = point_dist_weight_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)dst_points_->data(), 3, dst_points_->size());
                     data_map.bottomRows(3) = color_dist_weight_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)dst_colors_->data(), 3, dst_colors_->size());
-                    kd_tree = new KDTree<float,6,KDTreeDistanceAdaptors::L2>(data_holder);
+                    kd_tree = new KDTree<float,6,KDTreeDistanceAdaptors::L2Vectorized>(data_holder);
                 }
 #pragma omp parallel for shared (residuals) private (neighbor, distance)
                 for (size_t i = 0; i < src_points_trans_.size(); i++) {
@@ -620,7 +575,7 @@ namespace cilantro {
                 break;
             }
             case CorrespondencesType::NORMALS_COLORS: {
-                KDTree<float,6,KDTreeDistanceAdaptors::L2> *kd_tree;
+                KDTree<float,6,KDTreeDistanceAdaptors::L2Vectorized> *kd_tree;
                 std::vector<Eigen::Matrix<float,6,1> > data_holder;
                 if (req_corr_type == corr_type_) {
                     kd_tree = kd_tree_6d_;
@@ -629,7 +584,7 @@ namespace cilantro {
                     Eigen::Map<Eigen::Matrix<float,6,Eigen::Dynamic> > data_map((float *)data_holder.data(), 6, data_holder.size());
                     data_map.topRows(3) = normal_dist_weight_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)dst_normals_->data(), 3, dst_normals_->size());
                     data_map.bottomRows(3) = color_dist_weight_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)dst_colors_->data(), 3, dst_colors_->size());
-                    kd_tree = new KDTree<float,6,KDTreeDistanceAdaptors::L2>(data_holder);
+                    kd_tree = new KDTree<float,6,KDTreeDistanceAdaptors::L2Vectorized>(data_holder);
                 }
 #pragma omp parallel for shared (residuals) private (neighbor, distance)
                 for (size_t i = 0; i < src_points_trans_.size(); i++) {
@@ -663,7 +618,7 @@ namespace cilantro {
                 break;
             }
             case CorrespondencesType::POINTS_NORMALS_COLORS: {
-                KDTree<float,9,KDTreeDistanceAdaptors::L2> *kd_tree;
+                KDTree<float,9,KDTreeDistanceAdaptors::L2Vectorized> *kd_tree;
                 std::vector<Eigen::Matrix<float,9,1> > data_holder;
                 if (req_corr_type == corr_type_) {
                     kd_tree = kd_tree_9d_;
@@ -673,7 +628,7 @@ namespace cilantro {
                     data_map.topRows(3) = point_dist_weight_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)dst_points_->data(), 3, dst_points_->size());
                     data_map.block(3,0,3,dst_data_points_9d_.size()) = normal_dist_weight_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)dst_normals_->data(), 3, dst_normals_->size());
                     data_map.bottomRows(3) = color_dist_weight_*Eigen::Map<Eigen::Matrix<float,3,Eigen::Dynamic> >((float *)dst_colors_->data(), 3, dst_colors_->size());
-                    kd_tree = new KDTree<float,9,KDTreeDistanceAdaptors::L2>(data_holder);
+                    kd_tree = new KDTree<float,9,KDTreeDistanceAdaptors::L2Vectorized>(data_holder);
                 }
 #pragma omp parallel for shared (residuals) private (neighbor, distance)
                 for (size_t i = 0; i < src_points_trans_.size(); i++) {
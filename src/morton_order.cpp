@@ -0,0 +1,61 @@
+#include <cilantro/morton_order.hpp>
+#include <cilantro/radix_sort.hpp>
+
+namespace cilantro {
+    // Spreads the lowest 21 bits of x so that there are two zero bits between consecutive bits
+    static inline uint64_t spread_bits(uint64_t x) {
+        x &= 0x1FFFFF;
+        x = (x | (x << 32)) & 0x1F00000000FFFF;
+        x = (x | (x << 16)) & 0x1F0000FF0000FF;
+        x = (x | (x << 8)) & 0x100F00F00F00F00F;
+        x = (x | (x << 4)) & 0x10C30C30C30C30C3;
+        x = (x | (x << 2)) & 0x1249249249249249;
+        return x;
+    }
+
+    static void reorder_vectors(std::vector<Eigen::Vector3f> &vectors, const std::vector<size_t> &permutation) {
+        std::vector<Eigen::Vector3f> tmp(vectors.size());
+#pragma omp parallel for
+        for (size_t i = 0; i < permutation.size(); i++) {
+            tmp[i] = vectors[permutation[i]];
+        }
+        vectors.swap(tmp);
+    }
+
+    std::vector<uint64_t> computeMortonCodes(const std::vector<Eigen::Vector3f> &points) {
+        std::vector<uint64_t> codes(points.size());
+        if (points.empty()) return codes;
+
+        Eigen::Vector3f min_pt(points[0]), max_pt(points[0]);
+        for (size_t i = 1; i < points.size(); i++) {
+            min_pt = min_pt.cwiseMin(points[i]);
+            max_pt = max_pt.cwiseMax(points[i]);
+        }
+        const float max_extent = (max_pt - min_pt).maxCoeff();
+        const float max_coord = (float)((1 << 21) - 1);
+        const float scale = (max_extent > 0.0f) ? max_coord/max_extent : 0.0f;
+
+#pragma omp parallel for
+        for (size_t i = 0; i < points.size(); i++) {
+            Eigen::Vector3f q(((points[i] - min_pt)*scale).cwiseMin(max_coord));
+            codes[i] = spread_bits((uint64_t)q[0]) | (spread_bits((uint64_t)q[1]) << 1) | (spread_bits((uint64_t)q[2]) << 2);
+        }
+
+        return codes;
+    }
+
+    std::vector<size_t> getMortonOrder(const std::vector<Eigen::Vector3f> &points) {
+        std::vector<uint64_t> codes(computeMortonCodes(points));
+        std::vector<size_t> order;
+        radixSort(codes, order);
+        return order;
+    }
+
+    std::vector<size_t> sortByMortonOrder(PointCloud &cloud) {
+        std::vector<size_t> permutation(getMortonOrder(cloud.points));
+        reorder_vectors(cloud.points, permutation);
+        if (cloud.hasNormals()) reorder_vectors(cloud.normals, permutation);
+        if (cloud.hasColors()) reorder_vectors(cloud.colors, permutation);
+        return permutation;
+    }
+}
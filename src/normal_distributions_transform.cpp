@@ -0,0 +1,267 @@
+#include <cilantro/normal_distributions_transform.hpp>
+
+namespace cilantro {
+    NormalDistributionsTransform::NormalDistributionsTransform(const std::vector<Eigen::Vector3f> &dst_p, const std::vector<Eigen::Vector3f> &src_p, float resolution)
+            : dst_points_(&dst_p),
+              src_points_(&src_p),
+              resolution_(resolution),
+              grid_(NULL),
+              num_valid_cells_(0),
+              has_converged_(false),
+              iteration_count_(0),
+              score_(0.0f)
+    {
+        init_params_();
+    }
+
+    NormalDistributionsTransform::NormalDistributionsTransform(const PointCloud &dst, const PointCloud &src, float resolution)
+            : dst_points_(&dst.points),
+              src_points_(&src.points),
+              resolution_(resolution),
+              grid_(NULL),
+              num_valid_cells_(0),
+              has_converged_(false),
+              iteration_count_(0),
+              score_(0.0f)
+    {
+        init_params_();
+    }
+
+    NormalDistributionsTransform::~NormalDistributionsTransform() {
+        delete_cells_();
+    }
+
+    void NormalDistributionsTransform::init_params_() {
+        min_points_per_cell_ = 6;
+        outlier_ratio_ = 0.55f;
+        max_step_length_ = 0.1f;
+        convergence_tol_ = 1e-3f;
+        max_iter_ = 35;
+
+        rot_mat_init_.setIdentity();
+        t_vec_init_.setZero();
+    }
+
+    void NormalDistributionsTransform::build_cells_() {
+        if (grid_ != NULL) return;
+
+        grid_ = new VoxelGrid(*dst_points_, resolution_);
+        std::vector<Eigen::Vector3f> means;
+        std::vector<Eigen::Matrix3f> covariances;
+        grid_->getBinStatistics(&means, &covariances);
+
+        const size_t num_bins = grid_->getNumberOfBins();
+        const size_t min_points = std::max<size_t>(min_points_per_cell_, 3);
+        cells_.resize(num_bins);
+        size_t num_valid = 0;
+
+#pragma omp parallel for reduction (+: num_valid)
+        for (size_t b = 0; b < num_bins; b++) {
+            Cell_ &cell(cells_[b]);
+            cell.valid = false;
+            const size_t num_bin_points = grid_->getBinPointCount(b);
+            if (num_bin_points < min_points) continue;
+
+            // Unbiased sample covariance
+            const Eigen::Matrix3d cov(covariances[b].cast<double>()*((double)num_bin_points/(num_bin_points - 1)));
+
+            // Near-planar or linear bins: small eigenvalues are raised to a fraction of the largest, so that
+            // the inverse stays bounded
+            Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eig(cov);
+            Eigen::Vector3d eigenvalues(eig.eigenvalues());
+            if (!(eigenvalues[2] > 0.0)) continue;
+            eigenvalues = eigenvalues.cwiseMax(0.01*eigenvalues[2]);
+
+            cell.mean = means[b];
+            cell.inverseCovariance = (eig.eigenvectors()*eigenvalues.cwiseInverse().asDiagonal()*eig.eigenvectors().transpose()).cast<float>();
+            cell.valid = true;
+            num_valid++;
+        }
+        num_valid_cells_ = num_valid;
+    }
+
+    void NormalDistributionsTransform::delete_cells_() {
+        delete grid_;
+        grid_ = NULL;
+        cells_.clear();
+        num_valid_cells_ = 0;
+    }
+
+    Eigen::Matrix3f NormalDistributionsTransform::orthonormalize_rotation_(const Eigen::Matrix3f &rot_mat) const {
+        Eigen::JacobiSVD<Eigen::Matrix3f> svd(rot_mat, Eigen::ComputeFullU | Eigen::ComputeFullV);
+        if (svd.matrixU().determinant() * svd.matrixV().determinant() < 0.0f) {
+            Eigen::Matrix3f U(svd.matrixU());
+            U.col(2) *= -1.0f;
+            return U*svd.matrixV().transpose();
+        } else {
+            return svd.matrixU()*svd.matrixV().transpose();
+        }
+    }
+
+    // Derivatives with respect to a left perturbation (rotation vector, translation) of the transformation.
+    // Sums run over fixed chunks of the source points and are added in chunk order, so the result does not
+    // depend on the number of threads.
+    void NormalDistributionsTransform::compute_derivatives_(const Eigen::Matrix3f &rot_mat, const Eigen::Vector3f &t_vec, Derivatives_ &res) const {
+        // Gaussian fit of the mixture of the cell's normal distribution and a uniform outlier distribution
+        const double c1 = 10.0*(1.0 - outlier_ratio_);
+        const double c2 = outlier_ratio_/((double)resolution_*resolution_*resolution_);
+        const double d3 = -std::log(c2);
+        const double d1 = -std::log(c1 + c2) - d3;
+        const double d2 = -2.0*std::log((-std::log(c1*std::exp(-0.5) + c2) - d3)/d1);
+
+        const std::vector<Eigen::Vector3f> &points(*src_points_);
+        const size_t num_points = points.size();
+        const size_t num_chunks = std::max<size_t>(1, std::min<size_t>(64, num_points/1024));
+        const size_t chunk_size = (num_points + num_chunks - 1)/num_chunks;
+
+        // Per chunk: value, gradient (6), Hessian (36), approximate Hessian (36), point count
+        const size_t stride = 80;
+        std::vector<double> chunk_sums(num_chunks*stride, 0.0);
+
+#pragma omp parallel for
+        for (size_t c = 0; c < num_chunks; c++) {
+            double value = 0.0;
+            Eigen::Matrix<double,6,1> gradient(Eigen::Matrix<double,6,1>::Zero());
+            Eigen::Matrix<double,6,6> hessian(Eigen::Matrix<double,6,6>::Zero());
+            Eigen::Matrix<double,6,6> hessian_approx(Eigen::Matrix<double,6,6>::Zero());
+            size_t num_used = 0;
+
+            Eigen::Matrix<double,3,6> jacobian;
+
+            const size_t end = std::min(num_points, (c + 1)*chunk_size);
+            for (size_t i = c*chunk_size; i < end; i++) {
+                const Eigen::Vector3f x(rot_mat*points[i] + t_vec);
+                size_t bin;
+                if (!grid_->findBin(x, bin) || !cells_[bin].valid) continue;
+                const Cell_ &cell(cells_[bin]);
+
+                const Eigen::Vector3d diff((x - cell.mean).cast<double>());
+                const Eigen::Matrix3d inv_cov(cell.inverseCovariance.cast<double>());
+                const Eigen::Vector3d inv_cov_diff(inv_cov*diff);
+                const double e = std::exp(-0.5*d2*diff.dot(inv_cov_diff));
+
+                // d(x)/d(rotation) = -[x]_x
+                const Eigen::Vector3d xd(x.cast<double>());
+                jacobian << 0.0, xd[2], -xd[1], 1.0, 0.0, 0.0,
+                            -xd[2], 0.0, xd[0], 0.0, 1.0, 0.0,
+                            xd[1], -xd[0], 0.0, 0.0, 0.0, 1.0;
+
+                const double w = -d1*d2*e;
+                const Eigen::Matrix<double,6,1> a(jacobian.transpose()*inv_cov_diff);
+                const Eigen::Matrix<double,6,6> jtj(jacobian.transpose()*inv_cov*jacobian);
+
+                value += d1*e;
+                gradient += w*a;
+                hessian_approx += w*jtj;
+                // Second-order term of the rotation, diff^T*inv_cov*d2(x)/d(rotation)^2 (x is linear in the
+                // translation)
+                const Eigen::Matrix3d rot_second(0.5*(inv_cov_diff*xd.transpose() + xd*inv_cov_diff.transpose()) - inv_cov_diff.dot(xd)*Eigen::Matrix3d::Identity());
+                hessian += w*(jtj - d2*a*a.transpose());
+                hessian.topLeftCorner<3,3>() += w*rot_second;
+                num_used++;
+            }
+
+            double * sums = chunk_sums.data() + c*stride;
+            sums[0] = value;
+            Eigen::Map<Eigen::Matrix<double,6,1> >(sums + 1) = gradient;
+            Eigen::Map<Eigen::Matrix<double,6,6> >(sums + 7) = hessian;
+            Eigen::Map<Eigen::Matrix<double,6,6> >(sums + 43) = hessian_approx;
+            sums[79] = (double)num_used;
+        }
+
+        res.value = 0.0;
+        res.gradient.setZero();
+        res.hessian.setZero();
+        res.hessianApprox.setZero();
+        res.numPoints = 0;
+        for (size_t c = 0; c < num_chunks; c++) {
+            const double * sums = chunk_sums.data() + c*stride;
+            res.value += sums[0];
+            res.gradient += Eigen::Map<const Eigen::Matrix<double,6,1> >(sums + 1);
+            res.hessian += Eigen::Map<const Eigen::Matrix<double,6,6> >(sums + 7);
+            res.hessianApprox += Eigen::Map<const Eigen::Matrix<double,6,6> >(sums + 43);
+            res.numPoints += (size_t)sums[79];
+        }
+    }
+
+    void NormalDistributionsTransform::estimate_transform_() {
+        build_cells_();
+
+        has_converged_ = false;
+
+        rot_mat_ = rot_mat_init_;
+        t_vec_ = t_vec_init_;
+
+        Derivatives_ curr, next;
+        compute_derivatives_(rot_mat_, t_vec_, curr);
+
+        Eigen::Matrix3f rot_mat_iter;
+        Eigen::Matrix3f rot_mat_next;
+        Eigen::Vector3f t_vec_next;
+
+        iteration_count_ = 0;
+        while (iteration_count_ < max_iter_) {
+            iteration_count_++;
+
+            if (curr.numPoints < 6) {
+                has_converged_ = false;
+                break;
+            }
+
+            // Newton direction; away from the optimum the full Hessian may be indefinite, in which case the
+            // positive semidefinite part is used instead
+            Eigen::Matrix<double,6,1> delta;
+            Eigen::LDLT<Eigen::Matrix<double,6,6> > ldlt(curr.hessian);
+            if (ldlt.info() == Eigen::Success && ldlt.isPositive() && (ldlt.vectorD().array() > 0.0).all()) {
+                delta = -ldlt.solve(curr.gradient);
+            } else {
+                delta = -curr.hessianApprox.ldlt().solve(curr.gradient);
+            }
+            if (!delta.allFinite() || curr.gradient.dot(delta) >= 0.0) {
+                has_converged_ = curr.gradient.norm() < convergence_tol_;
+                break;
+            }
+            if (delta.norm() > max_step_length_) delta *= max_step_length_/delta.norm();
+
+            // Backtracking line search on the score; the derivatives at the accepted point are reused for the
+            // next step
+            double step = 1.0;
+            bool accepted = false;
+            for (size_t k = 0; k < 10; k++) {
+                const Eigen::Matrix<double,6,1> step_delta(step*delta);
+                const double angle = step_delta.head(3).norm();
+                if (angle > 0.0) {
+                    rot_mat_iter = Eigen::AngleAxisf((float)angle, (step_delta.head(3)/angle).cast<float>()).toRotationMatrix();
+                } else {
+                    rot_mat_iter.setIdentity();
+                }
+                rot_mat_next = orthonormalize_rotation_(rot_mat_iter*rot_mat_);
+                t_vec_next = rot_mat_iter*t_vec_ + step_delta.tail(3).cast<float>();
+
+                compute_derivatives_(rot_mat_next, t_vec_next, next);
+                if (next.value <= curr.value + 1e-4*step*curr.gradient.dot(delta)) {
+                    accepted = true;
+                    break;
+                }
+                step *= 0.5;
+            }
+
+            if (!accepted) {
+                // No decrease along the descent direction: the score is at a (local) optimum
+                has_converged_ = true;
+                break;
+            }
+
+            rot_mat_ = rot_mat_next;
+            t_vec_ = t_vec_next;
+            std::swap(curr, next);
+
+            if (step*delta.norm() < convergence_tol_) {
+                has_converged_ = true;
+                break;
+            }
+        }
+
+        score_ = (src_points_->empty()) ? 0.0f : (float)(-curr.value/src_points_->size());
+    }
+}
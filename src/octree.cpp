@@ -0,0 +1,345 @@
+#include <cilantro/octree.hpp>
+#include <cstdint>
+
+namespace cilantro {
+    const size_t OctreeNode::NO_CHILD;
+
+    Octree::Octree(const std::vector<Eigen::Vector3f> &points, size_t max_leaf_size, size_t max_depth)
+            : input_points_(&points),
+              input_normals_(NULL),
+              input_colors_(NULL),
+              max_leaf_size_(std::max(max_leaf_size, (size_t)1)),
+              max_depth_(max_depth)
+    {
+        build_();
+    }
+
+    Octree::Octree(const PointCloud &cloud, size_t max_leaf_size, size_t max_depth)
+            : input_points_(&cloud.points),
+              input_normals_(cloud.hasNormals()?&cloud.normals:NULL),
+              input_colors_(cloud.hasColors()?&cloud.colors:NULL),
+              max_leaf_size_(std::max(max_leaf_size, (size_t)1)),
+              max_depth_(max_depth)
+    {
+        build_();
+    }
+
+    void Octree::nearestNeighborSearch(const Eigen::Vector3f &query_pt, size_t &neighbor, float &distance, float eps) const {
+        if (nodes_.empty()) return;
+        KNNInRadiusResultSet<float,size_t> result_set(1, std::numeric_limits<float>::max());
+        result_set.init(&neighbor, &distance);
+        find_neighbors_(0, query_pt, result_set, 1.0f + eps);
+    }
+
+    void Octree::kNNSearch(const Eigen::Vector3f &query_pt, size_t k, std::vector<size_t> &neighbors, std::vector<float> &distances, float eps) const {
+        k = std::min(k, point_indices_.size());
+        neighbors.resize(k);
+        distances.resize(k);
+        if (k == 0) return;
+        KNNInRadiusResultSet<float,size_t> result_set(k, std::numeric_limits<float>::max());
+        result_set.init(neighbors.data(), distances.data());
+        find_neighbors_(0, query_pt, result_set, 1.0f + eps);
+    }
+
+    void Octree::radiusSearch(const Eigen::Vector3f &query_pt, float radius, std::vector<size_t> &neighbors, std::vector<float> &distances, float eps) const {
+        std::vector<std::pair<size_t,float> > matches;
+        radius_search_(query_pt, radius, matches, neighbors, distances, eps);
+    }
+
+    void Octree::kNNInRadiusSearch(const Eigen::Vector3f &query_pt, size_t k, float radius, std::vector<size_t> &neighbors, std::vector<float> &distances, float eps) const {
+        neighbors.resize(k);
+        distances.resize(k);
+        if (k == 0 || nodes_.empty()) {
+            neighbors.clear();
+            distances.clear();
+            return;
+        }
+        KNNInRadiusResultSet<float,size_t> result_set(k, radius);
+        result_set.init(neighbors.data(), distances.data());
+        find_neighbors_(0, query_pt, result_set, 1.0f + eps);
+        neighbors.resize(result_set.size());
+        distances.resize(result_set.size());
+    }
+
+    void Octree::boxSearch(const Eigen::Vector3f &min_pt, const Eigen::Vector3f &max_pt, std::vector<size_t> &indices) const {
+        indices.clear();
+        if (!nodes_.empty()) box_search_(0, min_pt, max_pt, indices);
+    }
+
+    size_t Octree::boxCount(const Eigen::Vector3f &min_pt, const Eigen::Vector3f &max_pt) const {
+        return (nodes_.empty()) ? 0 : box_count_(0, min_pt, max_pt);
+    }
+
+    std::vector<std::vector<size_t> > Octree::getLevelOfDetailPointIndices(size_t depth, size_t min_points_in_bin) const {
+        std::vector<std::vector<size_t> > groups;
+        if (!nodes_.empty()) collect_level_of_detail_(0, depth, std::max(min_points_in_bin, (size_t)1), groups);
+        return groups;
+    }
+
+    std::vector<Eigen::Vector3f> Octree::getLevelOfDetailPoints(size_t depth, size_t min_points_in_bin) const {
+        std::vector<std::vector<size_t> > groups(getLevelOfDetailPointIndices(depth, min_points_in_bin));
+        std::vector<Eigen::Vector3f> points(groups.size());
+#pragma omp parallel for
+        for (size_t k = 0; k < groups.size(); k++) {
+            Eigen::Vector3f point(Eigen::Vector3f::Zero());
+            for (size_t i = 0; i < groups[k].size(); i++) {
+                point += (*input_points_)[groups[k][i]];
+            }
+            points[k] = point/groups[k].size();
+        }
+        return points;
+    }
+
+    PointCloud Octree::getLevelOfDetailCloud(size_t depth, size_t min_points_in_bin) const {
+        std::vector<std::vector<size_t> > groups(getLevelOfDetailPointIndices(depth, min_points_in_bin));
+
+        bool do_normals = input_normals_ != NULL;
+        bool do_colors = input_colors_ != NULL;
+
+        std::vector<Eigen::Vector3f> points(groups.size()), normals, colors;
+        if (do_normals) normals.resize(groups.size());
+        if (do_colors) colors.resize(groups.size());
+
+#pragma omp parallel for
+        for (size_t k = 0; k < groups.size(); k++) {
+            const std::vector<size_t> &bin_ind(groups[k]);
+            float scale = 1.0f/bin_ind.size();
+
+            Eigen::Vector3f point(Eigen::Vector3f::Zero());
+            for (size_t i = 0; i < bin_ind.size(); i++) {
+                point += (*input_points_)[bin_ind[i]];
+            }
+            points[k] = scale*point;
+
+            if (do_normals) {
+                Eigen::Vector3f normal(Eigen::Vector3f::Zero());
+                Eigen::Vector3f ref_dir = (*input_normals_)[bin_ind[0]];
+                size_t pos = 0, neg = 0;
+                for (size_t i = 0; i < bin_ind.size(); i++) {
+                    const Eigen::Vector3f& curr_normal = (*input_normals_)[bin_ind[i]];
+                    if (ref_dir.dot(curr_normal) < 0.0f) {
+                        normal -= curr_normal;
+                        neg++;
+                    } else {
+                        normal += curr_normal;
+                        pos++;
+                    }
+                }
+                if (neg > pos) normal *= -1.0f;
+                normals[k] = normal.normalized();
+            }
+
+            if (do_colors) {
+                Eigen::Vector3f color(Eigen::Vector3f::Zero());
+                for (size_t i = 0; i < bin_ind.size(); i++) {
+                    color += (*input_colors_)[bin_ind[i]];
+                }
+                colors[k] = scale*color;
+            }
+        }
+
+        return PointCloud(points, normals, colors);
+    }
+
+    void Octree::build_() {
+        size_t num_points = input_points_->size();
+        depth_ = 0;
+        root_half_size_ = 0.5f;
+        nodes_.clear();
+        point_indices_.resize(num_points);
+        for (size_t i = 0; i < num_points; i++) point_indices_[i] = i;
+        points_.resize(3, num_points);
+        if (num_points == 0) return;
+
+        Eigen::Vector3f min_pt((*input_points_)[0]), max_pt((*input_points_)[0]);
+        for (size_t i = 1; i < num_points; i++) {
+            min_pt = min_pt.cwiseMin((*input_points_)[i]);
+            max_pt = max_pt.cwiseMax((*input_points_)[i]);
+        }
+        float half_size = 0.5f*(max_pt - min_pt).maxCoeff();
+        if (half_size > 0.0f) root_half_size_ = half_size;
+
+        nodes_.reserve(2*num_points/max_leaf_size_ + 1);
+        std::vector<size_t> buffer(num_points);
+        build_node_(0.5f*(min_pt + max_pt), root_half_size_, 0, 0, num_points, buffer);
+
+#pragma omp parallel for
+        for (size_t i = 0; i < num_points; i++) {
+            points_.col(i) = (*input_points_)[point_indices_[i]];
+        }
+    }
+
+    size_t Octree::build_node_(const Eigen::Vector3f &center, float half_size, size_t depth, size_t begin, size_t end, std::vector<size_t> &buffer) {
+        size_t node_ind = nodes_.size();
+        nodes_.emplace_back();
+        OctreeNode &node(nodes_.back());
+        node.center = center;
+        node.halfSize = half_size;
+        node.depth = depth;
+        node.pointsBegin = begin;
+        node.pointsEnd = end;
+        node.isLeaf = true;
+        std::fill(node.children, node.children + 8, OctreeNode::NO_CHILD);
+        depth_ = std::max(depth_, depth);
+
+        if (end - begin <= max_leaf_size_ || depth >= max_depth_) {
+            Eigen::Vector3f centroid(Eigen::Vector3f::Zero());
+            for (size_t i = begin; i < end; i++) {
+                centroid += (*input_points_)[point_indices_[i]];
+            }
+            centroid /= (float)(end - begin);
+            Eigen::Matrix3f covariance(Eigen::Matrix3f::Zero());
+            for (size_t i = begin; i < end; i++) {
+                Eigen::Vector3f diff((*input_points_)[point_indices_[i]] - centroid);
+                covariance += diff*diff.transpose();
+            }
+            node.centroid = centroid;
+            node.covariance = covariance/(float)(end - begin);
+            return node_ind;
+        }
+        node.isLeaf = false;
+
+        // Counting sort of the node's points by octant
+        std::vector<unsigned char> octants(end - begin);
+        size_t offsets[9] = {0};
+        for (size_t i = begin; i < end; i++) {
+            const Eigen::Vector3f &pt((*input_points_)[point_indices_[i]]);
+            unsigned char octant = (pt[0] >= center[0]) | ((pt[1] >= center[1]) << 1) | ((pt[2] >= center[2]) << 2);
+            octants[i - begin] = octant;
+            offsets[octant + 1]++;
+        }
+        offsets[0] = begin;
+        for (size_t o = 0; o < 8; o++) offsets[o + 1] += offsets[o];
+        size_t pos[8];
+        std::copy(offsets, offsets + 8, pos);
+        for (size_t i = begin; i < end; i++) {
+            buffer[pos[octants[i - begin]]++] = point_indices_[i];
+        }
+        std::copy(buffer.begin() + begin, buffer.begin() + end, point_indices_.begin() + begin);
+
+        // Children statistics are merged pairwise (as in parallel variance computation)
+        float child_half_size = 0.5f*half_size;
+        size_t count = 0;
+        Eigen::Vector3f centroid(Eigen::Vector3f::Zero());
+        Eigen::Matrix3f scatter(Eigen::Matrix3f::Zero());
+        for (size_t o = 0; o < 8; o++) {
+            if (offsets[o] == offsets[o + 1]) continue;
+            Eigen::Vector3f offset((o & 1) ? child_half_size : -child_half_size, (o & 2) ? child_half_size : -child_half_size, (o & 4) ? child_half_size : -child_half_size);
+            size_t child_ind = build_node_(center + offset, child_half_size, depth + 1, offsets[o], offsets[o + 1], buffer);
+            nodes_[node_ind].children[o] = child_ind;
+
+            const OctreeNode &child(nodes_[child_ind]);
+            size_t child_count = child.getNumberOfPoints();
+            Eigen::Vector3f delta(child.centroid - centroid);
+            size_t merged_count = count + child_count;
+            scatter += child_count*child.covariance + ((float)count*child_count/merged_count)*delta*delta.transpose();
+            centroid += ((float)child_count/merged_count)*delta;
+            count = merged_count;
+        }
+        nodes_[node_ind].centroid = centroid;
+        nodes_[node_ind].covariance = scatter/(float)count;
+
+        return node_ind;
+    }
+
+    void Octree::box_search_(size_t node_ind, const Eigen::Vector3f &min_pt, const Eigen::Vector3f &max_pt, std::vector<size_t> &indices) const {
+        const OctreeNode &node(nodes_[node_ind]);
+        Eigen::Vector3f node_min(node.center.array() - node.halfSize), node_max(node.center.array() + node.halfSize);
+        if ((node_max.array() < min_pt.array()).any() || (node_min.array() > max_pt.array()).any()) return;
+        if ((node_min.array() >= min_pt.array()).all() && (node_max.array() <= max_pt.array()).all()) {
+            indices.insert(indices.end(), point_indices_.begin() + node.pointsBegin, point_indices_.begin() + node.pointsEnd);
+            return;
+        }
+        if (node.isLeaf) {
+            for (size_t i = node.pointsBegin; i < node.pointsEnd; i++) {
+                if ((points_.col(i).array() >= min_pt.array()).all() && (points_.col(i).array() <= max_pt.array()).all()) {
+                    indices.emplace_back(point_indices_[i]);
+                }
+            }
+            return;
+        }
+        for (size_t o = 0; o < 8; o++) {
+            if (node.children[o] != OctreeNode::NO_CHILD) box_search_(node.children[o], min_pt, max_pt, indices);
+        }
+    }
+
+    size_t Octree::box_count_(size_t node_ind, const Eigen::Vector3f &min_pt, const Eigen::Vector3f &max_pt) const {
+        const OctreeNode &node(nodes_[node_ind]);
+        Eigen::Vector3f node_min(node.center.array() - node.halfSize), node_max(node.center.array() + node.halfSize);
+        if ((node_max.array() < min_pt.array()).any() || (node_min.array() > max_pt.array()).any()) return 0;
+        if ((node_min.array() >= min_pt.array()).all() && (node_max.array() <= max_pt.array()).all()) return node.getNumberOfPoints();
+        size_t count = 0;
+        if (node.isLeaf) {
+            for (size_t i = node.pointsBegin; i < node.pointsEnd; i++) {
+                if ((points_.col(i).array() >= min_pt.array()).all() && (points_.col(i).array() <= max_pt.array()).all()) count++;
+            }
+            return count;
+        }
+        for (size_t o = 0; o < 8; o++) {
+            if (node.children[o] != OctreeNode::NO_CHILD) count += box_count_(node.children[o], min_pt, max_pt);
+        }
+        return count;
+    }
+
+    void Octree::collect_level_of_detail_(size_t node_ind, size_t depth, size_t min_points_in_bin, std::vector<std::vector<size_t> > &groups) const {
+        const OctreeNode &node(nodes_[node_ind]);
+        if (node.getNumberOfPoints() < min_points_in_bin) return;
+
+        if (node.depth == depth || (node.isLeaf && node.getNumberOfPoints() == 1)) {
+            groups.emplace_back(point_indices_.begin() + node.pointsBegin, point_indices_.begin() + node.pointsEnd);
+            return;
+        }
+
+        if (!node.isLeaf) {
+            for (size_t o = 0; o < 8; o++) {
+                if (node.children[o] != OctreeNode::NO_CHILD) collect_level_of_detail_(node.children[o], depth, min_points_in_bin, groups);
+            }
+            return;
+        }
+
+        // Leaf above the requested depth: split its points into the cells of that depth, in octree order
+        // (the cell coordinates are interleaved bitwise, most significant level first)
+        size_t levels = std::min(depth - node.depth, (size_t)21);
+        float cell_size = std::ldexp(2.0f*node.halfSize, -(int)levels);
+        ptrdiff_t max_coord = ((ptrdiff_t)1 << levels) - 1;
+        Eigen::Vector3f node_min(node.center.array() - node.halfSize);
+        std::vector<std::pair<uint64_t,size_t> > keyed(node.getNumberOfPoints());
+        for (size_t i = node.pointsBegin; i < node.pointsEnd; i++) {
+            uint64_t key = 0;
+            ptrdiff_t coords[3];
+            for (size_t d = 0; d < 3; d++) {
+                coords[d] = std::min(std::max((ptrdiff_t)std::floor((points_(d,i) - node_min[d])/cell_size), (ptrdiff_t)0), max_coord);
+            }
+            for (size_t l = levels; l > 0; l--) {
+                for (size_t d = 3; d > 0; d--) {
+                    key = (key << 1) | ((coords[d-1] >> (l-1)) & 1);
+                }
+            }
+            keyed[i - node.pointsBegin] = std::pair<uint64_t,size_t>(key, point_indices_[i]);
+        }
+        std::sort(keyed.begin(), keyed.end());
+        size_t first = 0;
+        for (size_t i = 1; i <= keyed.size(); i++) {
+            if (i < keyed.size() && keyed[i].first == keyed[first].first) continue;
+            if (i - first >= min_points_in_bin) {
+                groups.emplace_back(i - first);
+                for (size_t j = first; j < i; j++) groups.back()[j - first] = keyed[j].second;
+            }
+            first = i;
+        }
+    }
+
+    void Octree::radius_search_(const Eigen::Vector3f &query_pt, float radius, std::vector<std::pair<size_t,float> > &matches, std::vector<size_t> &neighbors, std::vector<float> &distances, float eps) const {
+        matches.clear();
+        RadiusResultSet_ result_set(radius, matches);
+        if (!nodes_.empty()) find_neighbors_(0, query_pt, result_set, 1.0f + eps);
+        std::sort(matches.begin(), matches.end(), [](const std::pair<size_t,float> &a, const std::pair<size_t,float> &b) { return a.second < b.second; });
+        size_t num_results = matches.size();
+        neighbors.resize(num_results);
+        distances.resize(num_results);
+        for (size_t i = 0; i < num_results; i++) {
+            neighbors[i] = matches[i].first;
+            distances[i] = matches[i].second;
+        }
+    }
+}
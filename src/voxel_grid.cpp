@@ -1,12 +1,13 @@
+#include <cassert>
 #include <cilantro/voxel_grid.hpp>
+#include <cilantro/radix_sort.hpp>
 
 namespace cilantro {
     VoxelGrid::VoxelGrid(const std::vector<Eigen::Vector3f> &points, float bin_size)
             : input_points_(&points),
               input_normals_(NULL),
               input_colors_(NULL),
-              bin_size_(bin_size),
-              empty_indices_(0)
+              bin_size_(bin_size)
     {
         build_lookup_table_();
     }
@@ -15,237 +16,423 @@ namespace cilantro {
             : input_points_(&cloud.points),
               input_normals_(cloud.hasNormals()?&cloud.normals:NULL),
               input_colors_(cloud.hasColors()?&cloud.colors:NULL),
-              bin_size_(bin_size),
-              empty_indices_(0)
+              bin_size_(bin_size)
     {
         build_lookup_table_();
     }
 
+    // Output slots are assigned before any output is computed, so bins are averaged in parallel while the
+    // output order stays that of the serial loop
     std::vector<Eigen::Vector3f> VoxelGrid::getDownsampledPoints(size_t min_points_in_bin) const {
-        std::vector<Eigen::Vector3f> points;
-        points.reserve(grid_lookup_table_.size());
-
-        Eigen::Vector3f point;
-        float scale;
-
-        for (size_t k = 0; k < map_iterators_.size(); k++) {
-            auto it = map_iterators_[k];
-
-            const std::vector<size_t>& bin_ind(it->second);
-            if (bin_ind.size() < min_points_in_bin) continue;
-
-            scale = 1.0f/bin_ind.size();
-
-            point.setZero();
-            for (size_t i = 0; i < bin_ind.size(); i++) {
-                point += (*input_points_)[bin_ind[i]];
-            }
-
-            points.emplace_back(scale*point);
+        std::vector<uint32_t> bins(get_output_bins_(min_points_in_bin));
+        std::vector<Eigen::Vector3f> points(bins.size());
+#pragma omp parallel for
+        for (size_t k = 0; k < bins.size(); k++) {
+            points[k] = average_(*input_points_, bins[k]);
         }
-
         return points;
     }
 
     std::vector<Eigen::Vector3f> VoxelGrid::getDownsampledNormals(size_t min_points_in_bin) const {
-        std::vector<Eigen::Vector3f> normals;
-        if (input_normals_ == NULL) {
-            return normals;
-        }
-
-//    normals.reserve(grid_lookup_table_.size());
-//    for (auto it = grid_lookup_table_.begin(); it != grid_lookup_table_.end(); ++it) {
-//        if (it->second.size() < min_points_in_bin) continue;
-//
-//        Eigen::MatrixXf bin_normals(3, it->second.size()*2);
-//        Eigen::Vector3f ref_dir = (*input_normals_)[it->second[0]];
-//        size_t pos = 0, neg = 0;
-//        for (size_t i = 0; i < it->second.size(); i++) {
-//            const Eigen::Vector3f& curr_normal = (*input_normals_)[it->second[i]];
-//            if (ref_dir.dot(curr_normal) < 0.0f) neg++; else pos++;
-//            bin_normals.col(2*i) = -curr_normal;
-//            bin_normals.col(2*i+1) = curr_normal;
-//        }
-//        if (neg > pos) ref_dir = -ref_dir;
-//
-//        PCA3D pca(bin_normals.data(), 3, it->second.size()*2);
-//        Eigen::Vector3f avg = pca.getEigenVectorsMatrix().col(0);
-//        if (ref_dir.dot(avg) < 0.0f) {
-//            normals.emplace_back(-avg);
-//        } else {
-//            normals.emplace_back(avg);
-//        }
-//    }
-
-        normals.reserve(grid_lookup_table_.size());
-
-        Eigen::Vector3f normal;
-
-        for (size_t k = 0; k < map_iterators_.size(); k++) {
-            auto it = map_iterators_[k];
-
-            const std::vector<size_t>& bin_ind(it->second);
-            if (bin_ind.size() < min_points_in_bin) continue;
-
-            normal.setZero();
-            Eigen::Vector3f ref_dir = (*input_normals_)[bin_ind[0]];
-            size_t pos = 0, neg = 0;
-            for (size_t i = 0; i < bin_ind.size(); i++) {
-                const Eigen::Vector3f& curr_normal = (*input_normals_)[bin_ind[i]];
-                if (ref_dir.dot(curr_normal) < 0.0f) {
-                    normal -= curr_normal;
-                    neg++;
-                } else {
-                    normal += curr_normal;
-                    pos++;
-                }
-            }
-            if (neg > pos) normal *= -1.0f;
+        if (input_normals_ == NULL) return std::vector<Eigen::Vector3f>();
 
-            normals.emplace_back(normal.normalized());
+        std::vector<uint32_t> bins(get_output_bins_(min_points_in_bin));
+        std::vector<Eigen::Vector3f> normals(bins.size());
+#pragma omp parallel for
+        for (size_t k = 0; k < bins.size(); k++) {
+            normals[k] = average_normal_(bins[k]);
         }
-
         return normals;
     }
 
     std::vector<Eigen::Vector3f> VoxelGrid::getDownsampledColors(size_t min_points_in_bin) const {
-        std::vector<Eigen::Vector3f> colors;
-        if (input_colors_ == NULL) return colors;
+        if (input_colors_ == NULL) return std::vector<Eigen::Vector3f>();
 
-        colors.reserve(grid_lookup_table_.size());
+        std::vector<uint32_t> bins(get_output_bins_(min_points_in_bin));
+        std::vector<Eigen::Vector3f> colors(bins.size());
+#pragma omp parallel for
+        for (size_t k = 0; k < bins.size(); k++) {
+            colors[k] = average_(*input_colors_, bins[k]);
+        }
+        return colors;
+    }
 
-        Eigen::Vector3f color;
-        float scale;
+    PointCloud VoxelGrid::getDownsampledCloud(size_t min_points_in_bin) const {
+        bool do_normals = input_normals_ != NULL;
+        bool do_colors = input_colors_ != NULL;
 
-        for (size_t k = 0; k < map_iterators_.size(); k++) {
-            auto it = map_iterators_[k];
+        std::vector<uint32_t> bins(get_output_bins_(min_points_in_bin));
+        std::vector<Eigen::Vector3f> points(bins.size());
+        std::vector<Eigen::Vector3f> normals((do_normals) ? bins.size() : 0);
+        std::vector<Eigen::Vector3f> colors((do_colors) ? bins.size() : 0);
+#pragma omp parallel for
+        for (size_t k = 0; k < bins.size(); k++) {
+            points[k] = average_(*input_points_, bins[k]);
+            if (do_normals) normals[k] = average_normal_(bins[k]);
+            if (do_colors) colors[k] = average_(*input_colors_, bins[k]);
+        }
 
-            const std::vector<size_t>& bin_ind(it->second);
-            if (bin_ind.size() < min_points_in_bin) continue;
+        return PointCloud(points, normals, colors);
+    }
 
-            scale = 1.0f/bin_ind.size();
+    std::vector<Eigen::Matrix3f> VoxelGrid::getDownsampledCovariances(size_t min_points_in_bin) const {
+        std::vector<Eigen::Matrix3f> covariances;
+        getDownsampledStatistics(NULL, &covariances, NULL, NULL, min_points_in_bin);
+        return covariances;
+    }
 
-            color.setZero();
-            for (size_t i = 0; i < bin_ind.size(); i++) {
-                color += (*input_colors_)[bin_ind[i]];
-            }
+    std::vector<size_t> VoxelGrid::getClosestToMeanIndices(size_t min_points_in_bin) const {
+        std::vector<size_t> indices;
+        getDownsampledStatistics(NULL, NULL, &indices, NULL, min_points_in_bin);
+        return indices;
+    }
 
-            colors.emplace_back(scale*color);
-        }
+    std::vector<size_t> VoxelGrid::getRandomPointIndices(size_t min_points_in_bin, unsigned int seed) const {
+        std::vector<size_t> indices;
+        getDownsampledStatistics(NULL, NULL, NULL, &indices, min_points_in_bin, seed);
+        return indices;
+    }
 
-        return colors;
+    // splitmix64 finalizer
+    static inline uint64_t hash_bin_seed(uint64_t x) {
+        x += 0x9E3779B97F4A7C15ULL;
+        x = (x ^ (x >> 30))*0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27))*0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
     }
 
-    PointCloud VoxelGrid::getDownsampledCloud(size_t min_points_in_bin) const {
-        std::vector<Eigen::Vector3f> points, normals, colors;
-        Eigen::Vector3f point, normal, color;
+    void VoxelGrid::getDownsampledStatistics(std::vector<Eigen::Vector3f> * means,
+                                             std::vector<Eigen::Matrix3f> * covariances,
+                                             std::vector<size_t> * closest_indices,
+                                             std::vector<size_t> * random_indices,
+                                             size_t min_points_in_bin,
+                                             unsigned int seed) const
+    {
+        compute_statistics_(get_output_bins_(min_points_in_bin), means, covariances, closest_indices, random_indices, seed);
+    }
 
-        bool do_normals = input_normals_ != NULL;
-        bool do_colors = input_colors_ != NULL;
+    void VoxelGrid::getBinStatistics(std::vector<Eigen::Vector3f> * means,
+                                     std::vector<Eigen::Matrix3f> * covariances,
+                                     std::vector<size_t> * closest_indices,
+                                     std::vector<size_t> * random_indices,
+                                     unsigned int seed) const
+    {
+        std::vector<uint32_t> bins(bin_keys_.size());
+        for (size_t i = 0; i < bins.size(); i++) {
+            bins[i] = (uint32_t)i;
+        }
+        compute_statistics_(bins, means, covariances, closest_indices, random_indices, seed);
+    }
 
-        points.reserve(grid_lookup_table_.size());
-        if (do_normals) normals.reserve(grid_lookup_table_.size());
-        if (do_colors) colors.reserve(grid_lookup_table_.size());
+    void VoxelGrid::compute_statistics_(const std::vector<uint32_t> &bins,
+                                        std::vector<Eigen::Vector3f> * means,
+                                        std::vector<Eigen::Matrix3f> * covariances,
+                                        std::vector<size_t> * closest_indices,
+                                        std::vector<size_t> * random_indices,
+                                        unsigned int seed) const
+    {
+        const std::vector<Eigen::Vector3f> &points(*input_points_);
+        if (means != NULL) means->resize(bins.size());
+        if (covariances != NULL) covariances->resize(bins.size());
+        if (closest_indices != NULL) closest_indices->resize(bins.size());
+        if (random_indices != NULL) random_indices->resize(bins.size());
+
+        const bool do_deviations = covariances != NULL || closest_indices != NULL;
+        const bool do_mean = means != NULL || do_deviations;
+#pragma omp parallel for
+        for (size_t k = 0; k < bins.size(); k++) {
+            const size_t num_bin_points = getBinPointCount(bins[k]);
+            const uint32_t * bin_ind = getBinPointIndices(bins[k]);
+
+            if (do_mean) {
+                const Eigen::Vector3f mean(average_(points, bins[k]));
+                if (means != NULL) (*means)[k] = mean;
+
+                // Deviations from the mean revisit only this bin's points, right after they were summed
+                if (do_deviations) {
+                    Eigen::Matrix3f scatter(Eigen::Matrix3f::Zero());
+                    float min_dist = std::numeric_limits<float>::infinity();
+                    size_t closest = bin_ind[0];
+                    for (size_t i = 0; i < num_bin_points; i++) {
+                        const Eigen::Vector3f diff(points[bin_ind[i]] - mean);
+                        scatter.noalias() += diff*diff.transpose();
+                        const float dist = diff.squaredNorm();
+                        if (dist < min_dist) {
+                            min_dist = dist;
+                            closest = bin_ind[i];
+                        }
+                    }
+                    if (covariances != NULL) (*covariances)[k] = scatter/(float)num_bin_points;
+                    if (closest_indices != NULL) (*closest_indices)[k] = closest;
+                }
+            }
 
-        float scale;
+            if (random_indices != NULL) {
+                const uint64_t hash = hash_bin_seed(((uint64_t)seed << 32) | bin_ind[0]);
+                (*random_indices)[k] = bin_ind[hash % num_bin_points];
+            }
+        }
+    }
 
-//    for (auto it = grid_lookup_table_.begin(); it != grid_lookup_table_.end(); ++it) {
-//#pragma omp parallel for shared (points, normals, colors) private (point, normal, color, scale) num_threads(4)
-        for (size_t k = 0; k < map_iterators_.size(); k++) {
-            auto it = map_iterators_[k];
+    std::vector<size_t> VoxelGrid::getGridBinNeighbors(const Eigen::Vector3f &point) const {
+        size_t bin;
+        if (!findBin(point, bin)) return std::vector<size_t>();
+        return std::vector<size_t>(getBinPointIndices(bin), getBinPointIndices(bin) + getBinPointCount(bin));
+    }
 
-            const std::vector<size_t>& bin_ind(it->second);
-            if (bin_ind.size() < min_points_in_bin) continue;
+    std::vector<size_t> VoxelGrid::getGridBinNeighbors(size_t point_ind) const {
+        return VoxelGrid::getGridBinNeighbors((*input_points_)[point_ind]);
+    }
 
-            scale = 1.0f/bin_ind.size();
+    bool VoxelGrid::findBin(const Eigen::Vector3f &point, size_t &bin) const {
+        uint64_t key, key_hi;
+        if (!get_bin_key_(point, key, key_hi)) return false;
+        if (bin_keys_hi_.empty()) {
+            auto it = std::lower_bound(bin_keys_.begin(), bin_keys_.end(), key);
+            if (it == bin_keys_.end() || *it != key) return false;
+            bin = it - bin_keys_.begin();
+            return true;
+        }
 
-            point.setZero();
-            for (size_t i = 0; i < bin_ind.size(); i++) {
-                point += (*input_points_)[bin_ind[i]];
+        // Wide keys: lower bound of (key_hi, key) in lexicographic order
+        size_t first = 0, last = bin_keys_.size();
+        while (first < last) {
+            const size_t mid = first + (last - first)/2;
+            if (bin_keys_hi_[mid] < key_hi || (bin_keys_hi_[mid] == key_hi && bin_keys_[mid] < key)) {
+                first = mid + 1;
+            } else {
+                last = mid;
             }
+        }
+        if (first == bin_keys_.size() || bin_keys_hi_[first] != key_hi || bin_keys_[first] != key) return false;
+        bin = first;
+        return true;
+    }
 
-            points.emplace_back(scale*point);
-
-            if (do_normals) {
-                normal.setZero();
-                Eigen::Vector3f ref_dir = (*input_normals_)[bin_ind[0]];
-                size_t pos = 0, neg = 0;
-                for (size_t i = 0; i < bin_ind.size(); i++) {
-                    const Eigen::Vector3f& curr_normal = (*input_normals_)[bin_ind[i]];
-                    if (ref_dir.dot(curr_normal) < 0.0f) {
-                        normal -= curr_normal;
-                        neg++;
-                    } else {
-                        normal += curr_normal;
-                        pos++;
-                    }
-                }
-                if (neg > pos) normal *= -1.0f;
+    // Ors coord into the 128-bit key (key_hi, key) at bit position shift
+    static inline void pack_coordinate(uint64_t coord, int shift, uint64_t &key, uint64_t &key_hi) {
+        if (shift < 64) {
+            key |= coord << shift;
+            if (shift > 0) key_hi |= coord >> (64 - shift);
+        } else {
+            key_hi |= coord << (shift - 64);
+        }
+    }
 
-                normals.emplace_back(normal.normalized());
-            }
+    void VoxelGrid::build_lookup_table_() {
+        min_pt_.fill(0.0f);
+        max_coords_.fill(0);
+        key_shifts_.fill(0);
+        bin_keys_.clear();
+        bin_keys_hi_.clear();
+        bin_offsets_.assign(1, 0);
+        point_indices_.clear();
+        bin_order_.clear();
+
+        const std::vector<Eigen::Vector3f> &points(*input_points_);
+        const size_t num_points = points.size();
+        if (num_points == 0) return;
+
+        // Point indices and bin offsets are 32-bit
+        assert(num_points <= (size_t)UINT32_MAX && "VoxelGrid supports at most 2^32 - 1 points");
+        if (num_points > (size_t)UINT32_MAX) return;
+
+        float min_x = std::numeric_limits<float>::infinity();
+        float min_y = std::numeric_limits<float>::infinity();
+        float min_z = std::numeric_limits<float>::infinity();
+#pragma omp parallel for reduction (min: min_x, min_y, min_z)
+        for (size_t i = 0; i < num_points; i++) {
+            if (points[i][0] < min_x) min_x = points[i][0];
+            if (points[i][1] < min_y) min_y = points[i][1];
+            if (points[i][2] < min_z) min_z = points[i][2];
+        }
+        // Round to integer grid coordinates
+        min_pt_[0] = std::floor(min_x/bin_size_)*bin_size_;
+        min_pt_[1] = std::floor(min_y/bin_size_)*bin_size_;
+        min_pt_[2] = std::floor(min_z/bin_size_)*bin_size_;
+
+        // Keys use as few bits per coordinate as the grid extent allows, so that radix sort passes over the
+        // (then constant) high bytes are skipped
+        float max_x = 0.0f, max_y = 0.0f, max_z = 0.0f;
+#pragma omp parallel for reduction (max: max_x, max_y, max_z)
+        for (size_t i = 0; i < num_points; i++) {
+            max_x = std::max(max_x, (points[i][0] - min_pt_[0])/bin_size_);
+            max_y = std::max(max_y, (points[i][1] - min_pt_[1])/bin_size_);
+            max_z = std::max(max_z, (points[i][2] - min_pt_[2])/bin_size_);
+        }
+        const float max_grid_coords[3] = {max_x, max_y, max_z};
+
+        // Up to 42 bits per coordinate, so that keys always fit in 128 bits
+        const float max_coord_limit = (float)((uint64_t)1 << 42);
+        for (size_t d = 0; d < 3; d++) {
+            assert(max_grid_coords[d] < max_coord_limit && "VoxelGrid supports at most 2^42 bins along each axis");
+            if (!(max_grid_coords[d] < max_coord_limit)) return;
+            max_coords_[d] = (uint64_t)max_grid_coords[d];
+        }
 
-            if (do_colors) {
-                color.setZero();
-                for (size_t i = 0; i < bin_ind.size(); i++) {
-                    color += (*input_colors_)[bin_ind[i]];
-                }
+        std::array<int,3> num_bits = {0, 0, 0};
+        for (size_t d = 0; d < 3; d++) {
+            while ((max_coords_[d] >> num_bits[d]) != 0) num_bits[d]++;
+        }
+        key_shifts_[0] = 0;
+        key_shifts_[1] = num_bits[0];
+        key_shifts_[2] = num_bits[0] + num_bits[1];
+
+        // More than 64 bits in total (e.g. over 2^21 bins along every axis): keys get a high word, and are
+        // sorted by their low and then (stably) by their high word
+        const bool wide_keys = num_bits[0] + num_bits[1] + num_bits[2] > 64;
+        std::vector<uint64_t> keys(num_points);
+        std::vector<uint64_t> keys_hi((wide_keys) ? num_points : 0);
+#pragma omp parallel for
+        for (size_t i = 0; i < num_points; i++) {
+            uint64_t key = 0, key_hi = 0;
+            for (size_t d = 0; d < 3; d++) {
+                pack_coordinate(std::min((uint64_t)((points[i][d] - min_pt_[d])/bin_size_), max_coords_[d]), key_shifts_[d], key, key_hi);
+            }
+            keys[i] = key;
+            if (wide_keys) keys_hi[i] = key_hi;
+        }
 
-                colors.emplace_back(scale*color);
+        // Stable, so that the points of each bin stay in increasing index order
+        radixSort(keys, point_indices_);
+        if (wide_keys) {
+            std::vector<uint64_t> sorted_keys_hi(num_points);
+#pragma omp parallel for
+            for (size_t i = 0; i < num_points; i++) {
+                sorted_keys_hi[i] = keys_hi[point_indices_[i]];
             }
+            std::vector<uint32_t> permutation;
+            radixSort(sorted_keys_hi, permutation);
+            std::vector<uint64_t> sorted_keys(num_points);
+            std::vector<uint32_t> sorted_indices(num_points);
+#pragma omp parallel for
+            for (size_t i = 0; i < num_points; i++) {
+                sorted_keys[i] = keys[permutation[i]];
+                sorted_indices[i] = point_indices_[permutation[i]];
+            }
+            keys.swap(sorted_keys);
+            keys_hi.swap(sorted_keys_hi);
+            point_indices_.swap(sorted_indices);
+        }
 
-//#pragma omp critical
-//        {
-//            points.emplace_back(scale*point);
-//            if (do_normals) normals.emplace_back(normal.normalized());
-//            if (do_colors) colors.emplace_back(scale*color);
-//        }
+        // Bin boundaries are counted and then written in parallel over fixed chunks of the sorted keys
+        const size_t num_chunks = std::max<size_t>(1, std::min<size_t>(64, num_points/16384));
+        const size_t chunk_size = (num_points + num_chunks - 1)/num_chunks;
+        std::vector<size_t> chunk_bins(num_chunks + 1, 0);
+#pragma omp parallel for
+        for (size_t c = 0; c < num_chunks; c++) {
+            const size_t end = std::min(num_points, (c + 1)*chunk_size);
+            for (size_t i = c*chunk_size; i < end; i++) {
+                if (i == 0 || keys[i] != keys[i-1] || (wide_keys && keys_hi[i] != keys_hi[i-1])) chunk_bins[c+1]++;
+            }
+        }
+        for (size_t c = 0; c < num_chunks; c++) {
+            chunk_bins[c+1] += chunk_bins[c];
+        }
 
+        const size_t num_bins = chunk_bins[num_chunks];
+        bin_keys_.resize(num_bins);
+        bin_keys_hi_.resize((wide_keys) ? num_bins : 0);
+        bin_offsets_.resize(num_bins + 1);
+#pragma omp parallel for
+        for (size_t c = 0; c < num_chunks; c++) {
+            size_t pos = chunk_bins[c];
+            const size_t end = std::min(num_points, (c + 1)*chunk_size);
+            for (size_t i = c*chunk_size; i < end; i++) {
+                if (i == 0 || keys[i] != keys[i-1] || (wide_keys && keys_hi[i] != keys_hi[i-1])) {
+                    bin_keys_[pos] = keys[i];
+                    if (wide_keys) bin_keys_hi_[pos] = keys_hi[i];
+                    bin_offsets_[pos] = (uint32_t)i;
+                    pos++;
+                }
+            }
         }
+        bin_offsets_[num_bins] = (uint32_t)num_points;
 
-        return PointCloud(points, normals, colors);
+        // Output order: bins sorted by their first point
+        std::vector<uint32_t> first_points(num_bins);
+#pragma omp parallel for
+        for (size_t i = 0; i < num_bins; i++) {
+            first_points[i] = point_indices_[bin_offsets_[i]];
+        }
+        radixSort(first_points, bin_order_);
     }
 
-    const std::vector<size_t>& VoxelGrid::getGridBinNeighbors(const Eigen::Vector3f &point) const {
-        std::array<int,3> grid_coords = {(int)((point[0] - min_pt_[0])/bin_size_), (int)((point[1] - min_pt_[1])/bin_size_), (int)((point[2] - min_pt_[2])/bin_size_)};
-        auto it = grid_lookup_table_.find(grid_coords);
-        if (it == grid_lookup_table_.end()) return empty_indices_;
-        return it->second;
+    bool VoxelGrid::get_bin_key_(const Eigen::Vector3f &point, uint64_t &key, uint64_t &key_hi) const {
+        key = 0;
+        key_hi = 0;
+        for (size_t d = 0; d < 3; d++) {
+            const float coord = std::floor((point[d] - min_pt_[d])/bin_size_);
+            if (!(coord >= 0.0f) || coord > (float)max_coords_[d]) return false;
+            pack_coordinate((uint64_t)coord, key_shifts_[d], key, key_hi);
+        }
+        return true;
     }
 
-    const std::vector<size_t>& VoxelGrid::getGridBinNeighbors(size_t point_ind) const {
-        return VoxelGrid::getGridBinNeighbors((*input_points_)[point_ind]);
+    // Bins with at least min_points_in_bin points, in output order; a prefix sum over fixed chunks of
+    // bin_order_ gives each chunk its output position
+    std::vector<uint32_t> VoxelGrid::get_output_bins_(size_t min_points_in_bin) const {
+        if (min_points_in_bin <= 1) return bin_order_;
+
+        const size_t num_bins = bin_order_.size();
+        const size_t num_chunks = std::max<size_t>(1, std::min<size_t>(64, num_bins/16384));
+        const size_t chunk_size = (num_bins + num_chunks - 1)/num_chunks;
+        std::vector<size_t> chunk_offsets(num_chunks + 1, 0);
+#pragma omp parallel for
+        for (size_t c = 0; c < num_chunks; c++) {
+            const size_t end = std::min(num_bins, (c + 1)*chunk_size);
+            for (size_t k = c*chunk_size; k < end; k++) {
+                if (getBinPointCount(bin_order_[k]) >= min_points_in_bin) chunk_offsets[c+1]++;
+            }
+        }
+        for (size_t c = 0; c < num_chunks; c++) {
+            chunk_offsets[c+1] += chunk_offsets[c];
+        }
+
+        std::vector<uint32_t> bins(chunk_offsets[num_chunks]);
+#pragma omp parallel for
+        for (size_t c = 0; c < num_chunks; c++) {
+            size_t pos = chunk_offsets[c];
+            const size_t end = std::min(num_bins, (c + 1)*chunk_size);
+            for (size_t k = c*chunk_size; k < end; k++) {
+                if (getBinPointCount(bin_order_[k]) >= min_points_in_bin) bins[pos++] = bin_order_[k];
+            }
+        }
+        return bins;
     }
 
-    void VoxelGrid::build_lookup_table_() {
-        if (input_points_->empty()) return;
+    Eigen::Vector3f VoxelGrid::average_(const std::vector<Eigen::Vector3f> &vectors, size_t bin) const {
+        const size_t num_bin_points = getBinPointCount(bin);
+        const uint32_t * bin_ind = getBinPointIndices(bin);
+        const float scale = 1.0f/num_bin_points;
 
-        min_pt_[0] = std::numeric_limits<float>::infinity();
-        min_pt_[1] = std::numeric_limits<float>::infinity();
-        min_pt_[2] = std::numeric_limits<float>::infinity();
-        for (size_t i = 0; i < input_points_->size(); i++) {
-            if ((*input_points_)[i][0] < min_pt_[0]) min_pt_[0] = (*input_points_)[i][0];
-            if ((*input_points_)[i][1] < min_pt_[1]) min_pt_[1] = (*input_points_)[i][1];
-            if ((*input_points_)[i][2] < min_pt_[2]) min_pt_[2] = (*input_points_)[i][2];
+        Eigen::Vector3f sum(Eigen::Vector3f::Zero());
+        for (size_t i = 0; i < num_bin_points; i++) {
+            sum += vectors[bin_ind[i]];
         }
-        // Round to integer grid coordinates
-        min_pt_[0] = std::floor(min_pt_[0]/bin_size_)*bin_size_;
-        min_pt_[1] = std::floor(min_pt_[1]/bin_size_)*bin_size_;
-        min_pt_[2] = std::floor(min_pt_[2]/bin_size_)*bin_size_;
-
-        map_iterators_.reserve(input_points_->size());
-        std::array<int,3> grid_coords;
-        for (size_t i = 0; i < input_points_->size(); i++) {
-            grid_coords[0] = (int)(((*input_points_)[i][0] - min_pt_[0])/bin_size_);
-            grid_coords[1] = (int)(((*input_points_)[i][1] - min_pt_[1])/bin_size_);
-            grid_coords[2] = (int)(((*input_points_)[i][2] - min_pt_[2])/bin_size_);
-
-            auto lb = grid_lookup_table_.lower_bound(grid_coords);
-            if(lb != grid_lookup_table_.end() && !(grid_lookup_table_.key_comp()(grid_coords, lb->first))) {
-                lb->second.emplace_back(i);
+        return scale*sum;
+    }
+
+    // Sum of the bin's normals, flipped to agree with the first one (and with the majority of them)
+    Eigen::Vector3f VoxelGrid::average_normal_(size_t bin) const {
+        const size_t num_bin_points = getBinPointCount(bin);
+        const uint32_t * bin_ind = getBinPointIndices(bin);
+
+        Eigen::Vector3f normal(Eigen::Vector3f::Zero());
+        Eigen::Vector3f ref_dir = (*input_normals_)[bin_ind[0]];
+        size_t pos = 0, neg = 0;
+        for (size_t i = 0; i < num_bin_points; i++) {
+            const Eigen::Vector3f& curr_normal = (*input_normals_)[bin_ind[i]];
+            if (ref_dir.dot(curr_normal) < 0.0f) {
+                normal -= curr_normal;
+                neg++;
             } else {
-                map_iterators_.emplace_back(grid_lookup_table_.emplace_hint(lb, grid_coords, std::vector<size_t>(1, i)));
+                normal += curr_normal;
+                pos++;
             }
         }
+        if (neg > pos) normal *= -1.0f;
+
+        return normal.normalized();
     }
 }
@@ -0,0 +1,271 @@
+#include <cilantro/voxel_map.hpp>
+#include <cmath>
+#include <limits>
+#include <cilantro/radix_sort.hpp>
+
+namespace cilantro {
+    static const int voxel_coord_bits = 21;
+    static const int64_t voxel_coord_offset = (int64_t)1 << (voxel_coord_bits - 1);
+    static const uint64_t invalid_voxel_key = std::numeric_limits<uint64_t>::max();
+
+    VoxelMap::VoxelMap(float bin_size, bool compute_covariances)
+            : bin_size_(bin_size),
+              compute_covariances_(compute_covariances)
+    {
+        clear();
+    }
+
+    VoxelMap& VoxelMap::integrate(const PointCloud &cloud) {
+        return integrate(cloud, Eigen::Matrix4f::Identity());
+    }
+
+    VoxelMap& VoxelMap::integrate(const PointCloud &cloud, const Eigen::Ref<const Eigen::Matrix4f> &pose) {
+        num_frames_++;
+        const size_t num_points = cloud.size();
+        if (num_points == 0) return *this;
+
+        has_normals_ = has_normals_ && cloud.hasNormals();
+        has_colors_ = has_colors_ && cloud.hasColors();
+        const uint32_t frame = (uint32_t)num_frames_;
+        const Eigen::Matrix3f rotation(pose.topLeftCorner(3,3));
+        const Eigen::Vector3f translation(pose.topRightCorner(3,1));
+
+        std::vector<Eigen::Vector3f> points(num_points);
+        std::vector<uint64_t> keys(num_points);
+#pragma omp parallel for
+        for (size_t i = 0; i < num_points; i++) {
+            points[i] = rotation*cloud.points[i] + translation;
+            if (!get_voxel_key_(points[i], keys[i])) keys[i] = invalid_voxel_key;
+        }
+
+        // Points grouped by voxel (in input order within each voxel); out of range points sort last
+        std::vector<size_t> order;
+        radixSort(keys, order);
+
+        std::vector<size_t> run_offsets;
+        size_t num_valid = 0;
+        while (num_valid < num_points && keys[num_valid] != invalid_voxel_key) {
+            if (num_valid == 0 || keys[num_valid] != keys[num_valid-1]) run_offsets.emplace_back(num_valid);
+            num_valid++;
+        }
+        run_offsets.emplace_back(num_valid);
+        const size_t num_runs = run_offsets.size() - 1;
+
+        // Voxel slots are resolved (creating new voxels) serially; the frame's points are then merged into
+        // their (distinct) voxels in parallel
+        std::vector<size_t> run_voxels(num_runs);
+        for (size_t r = 0; r < num_runs; r++) {
+            const uint64_t key = keys[run_offsets[r]];
+            auto res = voxel_lookup_.emplace(key, voxels_.size());
+            if (res.second) {
+                Voxel_ voxel = {Eigen::Vector3d::Zero(), Eigen::Vector3f::Zero(), Eigen::Vector3f::Zero(), 0, frame};
+                voxels_.emplace_back(voxel);
+                voxel_keys_.emplace_back(key);
+                if (compute_covariances_) scatter_.emplace_back(std::array<double,6>{{0, 0, 0, 0, 0, 0}});
+            }
+            run_voxels[r] = res.first->second;
+        }
+
+#pragma omp parallel for schedule(dynamic, 256)
+        for (size_t r = 0; r < num_runs; r++) {
+            Voxel_ &voxel(voxels_[run_voxels[r]]);
+            const size_t begin = run_offsets[r];
+            const size_t end = run_offsets[r+1];
+            const double num_new = (double)(end - begin);
+            const double num_old = (double)voxel.count;
+
+            Eigen::Vector3d new_mean(Eigen::Vector3d::Zero());
+            for (size_t j = begin; j < end; j++) {
+                new_mean += points[order[j]].cast<double>();
+            }
+            new_mean /= num_new;
+
+            // Pairwise update of the mean and the scatter matrix (Chan et al.)
+            const Eigen::Vector3d delta(new_mean - voxel.mean);
+            voxel.mean += delta*(num_new/(num_old + num_new));
+            if (compute_covariances_) {
+                std::array<double,6> &scatter(scatter_[run_voxels[r]]);
+                const double w = num_old*num_new/(num_old + num_new);
+                scatter[0] += w*delta[0]*delta[0];
+                scatter[1] += w*delta[0]*delta[1];
+                scatter[2] += w*delta[0]*delta[2];
+                scatter[3] += w*delta[1]*delta[1];
+                scatter[4] += w*delta[1]*delta[2];
+                scatter[5] += w*delta[2]*delta[2];
+                for (size_t j = begin; j < end; j++) {
+                    const Eigen::Vector3d d(points[order[j]].cast<double>() - new_mean);
+                    scatter[0] += d[0]*d[0];
+                    scatter[1] += d[0]*d[1];
+                    scatter[2] += d[0]*d[2];
+                    scatter[3] += d[1]*d[1];
+                    scatter[4] += d[1]*d[2];
+                    scatter[5] += d[2]*d[2];
+                }
+            }
+
+            if (has_normals_) {
+                // Normals are flipped to agree with the voxel's accumulated normal (or its first one)
+                Eigen::Vector3f ref_dir = (voxel.count > 0) ? voxel.normalSum : (rotation*cloud.normals[order[begin]]).eval();
+                for (size_t j = begin; j < end; j++) {
+                    const Eigen::Vector3f normal(rotation*cloud.normals[order[j]]);
+                    if (ref_dir.dot(normal) < 0.0f) {
+                        voxel.normalSum -= normal;
+                    } else {
+                        voxel.normalSum += normal;
+                    }
+                }
+            }
+
+            if (has_colors_) {
+                for (size_t j = begin; j < end; j++) {
+                    voxel.colorSum += cloud.colors[order[j]];
+                }
+            }
+
+            voxel.count += (uint32_t)(end - begin);
+            voxel.lastFrame = frame;
+        }
+
+        return *this;
+    }
+
+    size_t VoxelMap::removeDistantVoxels(const Eigen::Vector3f &center, float max_distance) {
+        const Eigen::Vector3d center_d(center.cast<double>());
+        const double max_distance_sq = (double)max_distance*max_distance;
+        size_t num_removed = 0;
+        size_t i = 0;
+        while (i < voxels_.size()) {
+            if ((voxels_[i].mean - center_d).squaredNorm() > max_distance_sq) {
+                remove_voxel_(i);
+                num_removed++;
+            } else {
+                i++;
+            }
+        }
+        return num_removed;
+    }
+
+    size_t VoxelMap::removeStaleVoxels(size_t max_age) {
+        size_t num_removed = 0;
+        size_t i = 0;
+        while (i < voxels_.size()) {
+            if (voxels_[i].lastFrame + max_age <= num_frames_) {
+                remove_voxel_(i);
+                num_removed++;
+            } else {
+                i++;
+            }
+        }
+        return num_removed;
+    }
+
+    VoxelMap& VoxelMap::clear() {
+        has_normals_ = true;
+        has_colors_ = true;
+        num_frames_ = 0;
+        voxels_.clear();
+        voxel_keys_.clear();
+        scatter_.clear();
+        voxel_lookup_.clear();
+        return *this;
+    }
+
+    std::vector<Eigen::Vector3f> VoxelMap::getPoints(size_t min_points_in_bin) const {
+        std::vector<size_t> voxels(get_output_voxels_(min_points_in_bin));
+        std::vector<Eigen::Vector3f> points(voxels.size());
+#pragma omp parallel for
+        for (size_t k = 0; k < voxels.size(); k++) {
+            points[k] = voxels_[voxels[k]].mean.cast<float>();
+        }
+        return points;
+    }
+
+    std::vector<Eigen::Vector3f> VoxelMap::getNormals(size_t min_points_in_bin) const {
+        if (!hasNormals()) return std::vector<Eigen::Vector3f>();
+
+        std::vector<size_t> voxels(get_output_voxels_(min_points_in_bin));
+        std::vector<Eigen::Vector3f> normals(voxels.size());
+#pragma omp parallel for
+        for (size_t k = 0; k < voxels.size(); k++) {
+            normals[k] = voxels_[voxels[k]].normalSum.normalized();
+        }
+        return normals;
+    }
+
+    std::vector<Eigen::Vector3f> VoxelMap::getColors(size_t min_points_in_bin) const {
+        if (!hasColors()) return std::vector<Eigen::Vector3f>();
+
+        std::vector<size_t> voxels(get_output_voxels_(min_points_in_bin));
+        std::vector<Eigen::Vector3f> colors(voxels.size());
+#pragma omp parallel for
+        for (size_t k = 0; k < voxels.size(); k++) {
+            colors[k] = voxels_[voxels[k]].colorSum/(float)voxels_[voxels[k]].count;
+        }
+        return colors;
+    }
+
+    std::vector<size_t> VoxelMap::getPointCounts(size_t min_points_in_bin) const {
+        std::vector<size_t> voxels(get_output_voxels_(min_points_in_bin));
+        std::vector<size_t> counts(voxels.size());
+        for (size_t k = 0; k < voxels.size(); k++) {
+            counts[k] = voxels_[voxels[k]].count;
+        }
+        return counts;
+    }
+
+    std::vector<Eigen::Matrix3f> VoxelMap::getCovariances(size_t min_points_in_bin) const {
+        if (!compute_covariances_) return std::vector<Eigen::Matrix3f>();
+
+        std::vector<size_t> voxels(get_output_voxels_(min_points_in_bin));
+        std::vector<Eigen::Matrix3f> covariances(voxels.size());
+#pragma omp parallel for
+        for (size_t k = 0; k < voxels.size(); k++) {
+            const std::array<double,6> &scatter(scatter_[voxels[k]]);
+            const double scale = 1.0/voxels_[voxels[k]].count;
+            Eigen::Matrix3d cov;
+            cov << scatter[0], scatter[1], scatter[2],
+                   scatter[1], scatter[3], scatter[4],
+                   scatter[2], scatter[4], scatter[5];
+            covariances[k] = (scale*cov).cast<float>();
+        }
+        return covariances;
+    }
+
+    PointCloud VoxelMap::getCloud(size_t min_points_in_bin) const {
+        return PointCloud(getPoints(min_points_in_bin), getNormals(min_points_in_bin), getColors(min_points_in_bin));
+    }
+
+    bool VoxelMap::get_voxel_key_(const Eigen::Vector3f &point, uint64_t &key) const {
+        key = 0;
+        for (size_t d = 0; d < 3; d++) {
+            const double coord = std::floor((double)point[d]/bin_size_) + voxel_coord_offset;
+            if (!(coord >= 0.0 && coord < (double)((int64_t)1 << voxel_coord_bits))) return false;
+            key |= (uint64_t)coord << (d*voxel_coord_bits);
+        }
+        return true;
+    }
+
+    // The last voxel takes the freed slot
+    void VoxelMap::remove_voxel_(size_t ind) {
+        const size_t last = voxels_.size() - 1;
+        voxel_lookup_.erase(voxel_keys_[ind]);
+        if (ind != last) {
+            voxels_[ind] = voxels_[last];
+            voxel_keys_[ind] = voxel_keys_[last];
+            if (compute_covariances_) scatter_[ind] = scatter_[last];
+            voxel_lookup_[voxel_keys_[ind]] = ind;
+        }
+        voxels_.pop_back();
+        voxel_keys_.pop_back();
+        if (compute_covariances_) scatter_.pop_back();
+    }
+
+    std::vector<size_t> VoxelMap::get_output_voxels_(size_t min_points_in_bin) const {
+        std::vector<size_t> voxels;
+        voxels.reserve(voxels_.size());
+        for (size_t i = 0; i < voxels_.size(); i++) {
+            if (voxels_[i].count >= min_points_in_bin) voxels.emplace_back(i);
+        }
+        return voxels;
+    }
+}